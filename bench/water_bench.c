@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "water.h"
+
+// Water kernels against the original float loop: decoded output must match pixel for pixel, then time a full tick of each
+// make bench
+
+#define BENCH_TICKS	200
+
+static double Now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// WaterUpdate's loop before the kernels, kept as is
+static void WaterReference(const WaterBackground *bg, Color *output_px) {
+	for(uint32_t i = 0; i < PX_COUNT; i++) {
+		uint32_t x = ((i % 512) + bg->scroll_x) % 512; 
+		uint32_t y = ((i / 512) + bg->scroll_y) % 512;
+		uint32_t idxA = (x + y * 512);
+
+		uint32_t offx = ((i % 512) - bg->scroll_x + bg->offset) % 512;
+		uint32_t offy = ((i / 512) - bg->scroll_y - bg->offset) % 512;
+		uint32_t idxB = (offx + offy * 512);
+
+		float val = Clamp(((bg->noise[idxA] + bg->noise[idxB]) * bg->filter), 0, 255);
+		Color processed = (Color){val, val, val, val};
+
+		float intensity = val / 255.0f;
+
+		if(intensity > 0.79f) processed = (Color) { 0, 0, 0, 100 };
+		if(intensity > 0.99f) processed = (Color) { 240, 240, 250, 100};
+
+		output_px[i] = processed;
+	}
+}
+
+// Color of an output byte, what the water light shader does before premultiplying
+static Color BenchDecode(uint8_t code) {
+	if(code == WATER_CODE_DARK) return (Color) { 0, 0, 0, 100 };
+	if(code == WATER_CODE_LIGHT) return (Color) { 240, 240, 250, 100 };
+
+	return (Color) { code, code, code, code };
+}
+
+// Compare one kernel against the reference, prints the first mismatch
+static int BenchCheck(WaterBackground *bg, Color *reference, const char *name, WaterKernel kernel) {
+	WaterReference(bg, reference);
+	kernel(bg, 0, WATER_SIZE);
+
+	for(uint32_t i = 0; i < PX_COUNT; i++) {
+		Color r = reference[i], k = BenchDecode(bg->output_px[i]);
+		if(r.r == k.r && r.g == k.g && r.b == k.b && r.a == k.a) continue;
+
+		printf("ERROR: %s differs from reference, filter %.4f scroll %d pixel %u\n", name, bg->filter, bg->scroll_x, i);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main() {
+	WaterBackground bg = (WaterBackground) { .offset = 213, .filter = 0.86f };
+
+	// Uniform noise covers every sum and threshold case
+	bg.noise = malloc(PX_COUNT);
+	bg.output_px = malloc(PX_COUNT);
+	Color *reference = malloc(sizeof(Color) * PX_COUNT);
+
+	uint32_t seed = 0x9e3779b9;
+	for(uint32_t i = 0; i < PX_COUNT; i++) {
+		seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+		bg.noise[i] = seed >> 24;
+	}
+
+	struct { const char *name; WaterKernel kernel; bool supported; } kernels[] = {
+		{ "scalar", WaterKernelScalar, true },
+#ifdef __SSE2__
+		{ "sse2", WaterKernelSSE2, true },
+		{ "avx2", WaterKernelAVX2, __builtin_cpu_supports("avx2") },
+#endif
+	};
+
+	int kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+	const float filters[] = { 0, 0.25f, 0.5f, 0.7f, 0.79f, 0.86f, 0.95f, 0.9999f, 1 };
+	int failed = 0;
+
+	for(int k = 0; k < kernel_count; k++) {
+		if(!kernels[k].supported) continue;
+
+		for(size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+			for(int scroll = 0; scroll < WATER_SIZE; scroll += 37) {
+				bg.filter = filters[f];
+				bg.scroll_x = scroll, bg.scroll_y = (scroll * 7) % WATER_SIZE;
+
+				failed |= BenchCheck(&bg, reference, kernels[k].name, kernels[k].kernel);
+			}
+		}
+
+		// Whole filter range in the 0.001 steps of the arrow keys
+		for(int step = 0; step <= 1000; step++) {
+			bg.filter = Clamp(0.86f + (step - 860) * 0.001f, 0, 1);
+			bg.scroll_x = step % WATER_SIZE, bg.scroll_y = (step * 3) % WATER_SIZE;
+
+			failed |= BenchCheck(&bg, reference, kernels[k].name, kernels[k].kernel);
+		}
+	}
+
+	bg.filter = 0.86f;
+
+	for(int k = 0; k < kernel_count; k++) {
+		if(!kernels[k].supported) {
+			printf("%-8s not supported\n", kernels[k].name);
+			continue;
+		}
+
+		double start = Now();
+
+		for(int t = 0; t < BENCH_TICKS; t++) {
+			bg.scroll_x = (bg.scroll_x + 1) % WATER_SIZE;
+			bg.scroll_y = (bg.scroll_y + 1) % WATER_SIZE;
+
+			kernels[k].kernel(&bg, 0, WATER_SIZE);
+		}
+
+		printf("%-8s %.3f ms per tick\n", kernels[k].name, (Now() - start) * 1000.0 / BENCH_TICKS);
+	}
+
+	printf("%s\n", (failed) ? "output mismatch" : "output identical");
+
+	free(bg.noise);
+	free(bg.output_px);
+	free(reference);
+
+	return failed;
+}
@@ -0,0 +1,38 @@
+#version 330
+
+// DITHER variant adds noise dither, set by lights_deferred.c
+
+// G-buffer, same size as the screen
+uniform sampler2D g_position;
+uniform sampler2D g_normal;
+uniform sampler2D g_albedo;		// Alpha holds AO
+
+uniform float time;
+uniform vec3 ambient;
+
+// Output color
+out vec4 final_color;
+
+float noise(vec2 uv, float t) {
+    return fract(sin(dot(uv, vec2(12.9898, 78.233)) + (t * 0.0005)) * 43758.5453);
+}
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	// Nothing drawn here, keep background
+	vec3 normal = texelFetch(g_normal, pixel, 0).xyz;
+	if(dot(normal, normal) < 0.5) discard;
+
+	vec3 position = texelFetch(g_position, pixel, 0).xyz;
+	vec4 albedo = texelFetch(g_albedo, pixel, 0);
+
+	vec3 lit = albedo.rgb * ambient * albedo.a;
+
+	// Same dither as the forward shaders, applied once per pixel
+#ifdef DITHER
+	lit += noise(position.xz, time) * 0.025;
+#endif
+
+	final_color = vec4(lit, 1.0);
+}
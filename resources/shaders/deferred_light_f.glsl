@@ -0,0 +1,42 @@
+#version 330
+
+// G-buffer, same size as the screen
+uniform sampler2D g_position;
+uniform sampler2D g_normal;
+uniform sampler2D g_albedo;		// Alpha holds AO
+
+// Light of this volume
+uniform vec3 light_position;
+uniform vec3 light_color;
+uniform float light_range;
+uniform int light_index;
+
+uniform float time;
+
+// Output color, added onto the ambient pass
+out vec4 final_color;
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	vec3 normal = texelFetch(g_normal, pixel, 0).xyz;
+	if(dot(normal, normal) < 0.5) discard;
+
+	vec3 position = texelFetch(g_position, pixel, 0).xyz;
+
+	float breathe = sin(time * 2.0 + float(light_index) * 3.14) * 0.05 + 1.0;
+	float dyn_range = light_range * breathe;
+
+	// Volume covers pixels behind or in front of the light's reach too
+	float dist = distance(light_position, position);
+	if(dist >= dyn_range) discard;
+
+	vec4 albedo = texelFetch(g_albedo, pixel, 0);
+
+	vec3 light_dir = normalize(light_position - position);
+
+	float attenuation = 1.0 - smoothstep(0.0, dyn_range, dist);
+	float diffuse = max(dot(normal, light_dir), 0.0);
+
+	final_color = vec4(albedo.rgb * light_color * diffuse * attenuation * albedo.a, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330
+
+// Light volume sphere
+layout(location = 0) in vec3 vertex_position;
+
+// Uniforms (set from c code)
+uniform mat4 mvp;			// Model view projection matrix, model scales sphere to light range
+
+void main() {
+	gl_Position = mvp * vec4(vertex_position, 1.0);
+}
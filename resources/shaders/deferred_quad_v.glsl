@@ -0,0 +1,8 @@
+#version 330
+
+// Full screen quad of rlLoadDrawQuad, already in clip space
+layout(location = 0) in vec3 vertex_position;
+
+void main() {
+	gl_Position = vec4(vertex_position, 1.0);
+}
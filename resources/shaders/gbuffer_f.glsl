@@ -0,0 +1,36 @@
+#version 330
+
+// WATER variant decodes and premultiplies the water texture, set by lights.c
+
+// Input from vertex shader
+in vec2 frag_texcoord;	// Texture coordinates
+in vec3 frag_worldpos;
+in vec3 frag_normal;
+in float frag_ao;		// Ambient occlusion, 1 when open
+
+// Uniforms (set from game code)
+uniform sampler2D texture0;		// Texture to use
+
+// G-buffer attachments, see lights_deferred.c
+layout(location = 0) out vec4 g_position;
+layout(location = 1) out vec4 g_normal;
+layout(location = 2) out vec4 g_albedo;
+
+void main() {
+	vec4 tex_color = texture(texture0, frag_texcoord);
+
+#ifdef WATER
+	// Water texture holds a gray value or a code per pixel, see water.h
+	float water_code = floor(tex_color.r * 255.0 + 0.5);
+	tex_color = vec4(water_code / 255.0);
+	if(water_code == 254.0) tex_color = vec4(0, 0, 0, 100) / 255.0;
+	if(water_code == 255.0) tex_color = vec4(240, 240, 250, 100) / 255.0;
+
+	// Water used to pass through a cleared render target with alpha blending, keep its rgb * a
+	tex_color.rgb *= tex_color.a;
+#endif
+
+	g_position = vec4(frag_worldpos, 1.0);
+	g_normal = vec4(normalize(frag_normal), 1.0);
+	g_albedo = vec4(tex_color.rgb, frag_ao);
+}
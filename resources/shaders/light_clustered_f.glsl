@@ -0,0 +1,100 @@
+#version 330
+
+// DITHER variant adds noise dither, WATER decodes and premultiplies the water texture, set by lights.c
+
+// Cluster grid, keep in sync with lights.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_INDEX_WIDTH 512
+
+// Input from vertex shader
+in vec2 frag_texcoord;	// Texture coordinates
+in vec3 frag_worldpos;
+in vec3 frag_normal;
+in float frag_ao;		// Ambient occlusion, 1 when open
+
+// Uniforms (set from game code)
+uniform sampler2D texture0;		// Texture to use
+uniform vec4 col_diffuse;		// Base color(white by default)
+
+uniform sampler2D light_data;		// Per light, row 0 position and range, row 1 color
+uniform sampler2D cluster_grid;		// Per cluster, offset and count into light_indices
+uniform sampler2D light_indices;	// Light index lists of all clusters
+
+uniform vec4 cluster_view;		// Camera forward in xyz, view depth = dot(xyz, p) + w
+uniform vec2 cluster_depth;		// Near plane, slices per log unit of depth
+uniform vec2 cluster_screen;	// Framebuffer size in pixels
+
+uniform float time;
+uniform vec3 ambient;
+
+// Output color
+out vec4 final_color;
+
+float noise(vec2 uv, float t) {
+    return fract(sin(dot(uv, vec2(12.9898, 78.233)) + (t * 0.0005)) * 43758.5453);
+}
+
+void main() {
+	vec3 normal = normalize(frag_normal);
+
+	// Sample the texture at current UV coordinates
+	vec4 tex_color = texture(texture0, frag_texcoord);
+	vec4 tint = tex_color;
+
+#ifdef WATER
+	// Water texture holds a gray value or a code per pixel, see water.h
+	float water_code = floor(tex_color.r * 255.0 + 0.5);
+	tex_color = vec4(water_code / 255.0);
+	if(water_code == 254.0) tex_color = vec4(0, 0, 0, 100) / 255.0;
+	if(water_code == 255.0) tex_color = vec4(240, 240, 250, 100) / 255.0;
+
+	// Water used to pass through a cleared render target with alpha blending, keep its rgb * a, a * a
+	tex_color = vec4(tex_color.rgb * tex_color.a, tex_color.a * tex_color.a);
+	tint = tex_color;
+#endif
+
+	// Find fragment's cluster
+	ivec2 tile = ivec2(gl_FragCoord.xy / cluster_screen * vec2(CLUSTER_X, CLUSTER_Y));
+	tile = clamp(tile, ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+
+	float depth = max(dot(cluster_view.xyz, frag_worldpos) + cluster_view.w, cluster_depth.x);
+	int slice = clamp(int(log(depth / cluster_depth.x) * cluster_depth.y), 0, CLUSTER_Z - 1);
+
+	vec2 cluster = texelFetch(cluster_grid, ivec2(tile.x + tile.y * CLUSTER_X, slice), 0).xy;
+	int offset = int(cluster.x);
+	int count = int(cluster.y);
+
+	vec3 total_light = vec3(0);
+	for(int n = 0; n < count; n++) {
+		int index = offset + n;
+		int i = int(texelFetch(light_indices, ivec2(index % CLUSTER_INDEX_WIDTH, index / CLUSTER_INDEX_WIDTH), 0).r);
+
+		vec4 position_range = texelFetch(light_data, ivec2(i, 0), 0);
+		vec3 color = texelFetch(light_data, ivec2(i, 1), 0).rgb;
+
+		vec3 light_dir = normalize(position_range.xyz - frag_worldpos);
+		float dist = distance(position_range.xyz, frag_worldpos);
+
+		float breathe = sin(time * 2.0 + float(i) * 3.14) * 0.05 + 1.0;
+
+		float dyn_range = position_range.w * breathe;
+
+		float attenuation = 1.0 - smoothstep(0.0, dyn_range, dist);
+		float diffuse = max(dot(normal, light_dir), 0.0);
+
+		total_light += color * diffuse * attenuation;
+	}
+
+	total_light += ambient;
+	total_light *= frag_ao;
+
+	vec3 lit = tint.rgb * total_light;
+
+#ifdef DITHER
+	lit += noise(frag_worldpos.xz, time) * 0.025;
+#endif
+
+	final_color = vec4(lit, tex_color.a);
+}
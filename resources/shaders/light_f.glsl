@@ -1,11 +1,31 @@
 #version 330
 
+// Variants set by lights.c:
+// LIGHT_COUNT	size of the per-draw light list, loop is unrolled to exactly this many lights,
+//				unset loops to draw_light_count instead
+// BAKED		light comes from vertex colors, no per-fragment lighting
+// DITHER		add noise dither to hide banding
+// WATER		water texture, codes turned into colors premultiplied as the water tiles expect
 #define MAX_LIGHTS 16
 
+#ifdef LIGHT_COUNT
+#define DRAW_LIGHTS_SIZE LIGHT_COUNT
+#define DRAW_LIGHTS_END LIGHT_COUNT
+#else
+#define DRAW_LIGHTS_SIZE MAX_LIGHTS
+#define DRAW_LIGHTS_END draw_light_count
+#endif
+
 // Input from vertex shader
 in vec2 frag_texcoord;	// Texture coordinates
 in vec3 frag_worldpos;
+
+#ifdef BAKED
+in vec3 frag_light;		// Light interpolated between baked vertices
+#else
 in vec3 frag_normal;
+in float frag_ao;		// Ambient occlusion, 1 when open
+#endif
 
 // Uniforms (set from game code)
 uniform sampler2D texture0;		// Texture to use
@@ -13,11 +33,18 @@ uniform vec4 col_diffuse;		// Base color(white by default)
 uniform vec3 light_pos;			// Light position(set in game code)
 uniform float light_range;		// How far can light travel
 
-uniform int light_enabled[MAX_LIGHTS];
 uniform vec3 light_positions[MAX_LIGHTS];
 uniform vec3 light_colors[MAX_LIGHTS];
 uniform float light_ranges[MAX_LIGHTS];
-uniform int light_count;
+
+// Lights reaching the current draw, indices into the arrays above, -1 pads unused entries
+#if DRAW_LIGHTS_SIZE > 0
+uniform int draw_lights[DRAW_LIGHTS_SIZE];
+#endif
+
+#ifndef LIGHT_COUNT
+uniform int draw_light_count;
+#endif
 
 uniform float time;
 uniform vec3 ambient;
@@ -30,36 +57,58 @@ float noise(vec2 uv, float t) {
 }
 
 void main() {
-	vec3 normal = normalize(frag_normal);
-
 	// Sample the texture at current UV coordinates
 	vec4 tex_color = texture(texture0, frag_texcoord);
 	vec4 tint = tex_color;
 
+#ifdef WATER
+	// Water texture holds a gray value or a code per pixel, see water.h
+	float water_code = floor(tex_color.r * 255.0 + 0.5);
+	tex_color = vec4(water_code / 255.0);
+	if(water_code == 254.0) tex_color = vec4(0, 0, 0, 100) / 255.0;
+	if(water_code == 255.0) tex_color = vec4(240, 240, 250, 100) / 255.0;
+
+	// Water used to pass through a cleared render target with alpha blending, keep its rgb * a, a * a
+	tex_color = vec4(tex_color.rgb * tex_color.a, tex_color.a * tex_color.a);
+	tint = tex_color;
+#endif
+
+#ifdef BAKED
+	vec3 total_light = frag_light;
+#else
+	vec3 normal = normalize(frag_normal);
+
 	vec3 total_light = vec3(0);
-	for(int i = 0; i < light_count; i++) {
-		if(light_enabled[i] == 1) {
-			vec3 light_dir = normalize(light_positions[i] - frag_worldpos);
-			float dist = distance(light_positions[i], frag_worldpos);
 
-			float breathe = sin(time * 2.0 + float(i) * 3.14) * 0.05 + 1.0;
-			
-			float dyn_range = light_ranges[i] * breathe;
+#if DRAW_LIGHTS_SIZE > 0
+	for(int n = 0; n < DRAW_LIGHTS_END; n++) {
+		// Padding reads light 0 with zero weight instead of branching
+		int i = max(draw_lights[n], 0);
+		float weight = float(draw_lights[n] >= 0);
+
+		vec3 light_dir = normalize(light_positions[i] - frag_worldpos);
+		float dist = distance(light_positions[i], frag_worldpos);
 
-			float attenuation = 1.0 - smoothstep(0.0, dyn_range, dist);
-			float diffuse = max(dot(normal, light_dir), 0.0);
+		float breathe = sin(time * 2.0 + float(i) * 3.14) * 0.05 + 1.0;
+		
+		float dyn_range = light_ranges[i] * breathe;
 
-			total_light += light_colors[i] * diffuse * attenuation;
-		}
+		float attenuation = 1.0 - smoothstep(0.0, dyn_range, dist);
+		float diffuse = max(dot(normal, light_dir), 0.0);
+
+		total_light += light_colors[i] * diffuse * attenuation * weight;
 	}
+#endif
 
 	total_light += ambient;
+	total_light *= frag_ao;
+#endif
 
 	vec3 lit = tint.rgb * total_light;
 
-	float dither = noise(frag_worldpos.xz, time) * 0.025;
-	vec3 quantized = ((lit + dither) * 255.0) / 255.0;
+#ifdef DITHER
+	lit += noise(frag_worldpos.xz, time) * 0.025;
+#endif
 
-	final_color = vec4(quantized, tex_color.a);
+	final_color = vec4(lit, tex_color.a);
 }
-
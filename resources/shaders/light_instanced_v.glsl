@@ -0,0 +1,41 @@
+#version 330
+
+// Mesh attributes at raylib's default locations
+layout(location = 0) in vec3 vertex_position;
+layout(location = 1) in vec2 vertex_texcoord;
+layout(location = 2) in vec3 vertex_normal;
+
+// Per-instance model matrix, WATER variant keeps the instance's tile of the water texture
+// in the unused bottom row, m3 and m7 on the C side
+in mat4 instanceTransform;
+
+// Uniforms (set from c code)
+uniform mat4 mvp;			// View projection matrix, model part comes from instance
+
+// Outputs to fragment shader
+out vec2 frag_texcoord;
+out vec3 frag_worldpos;
+out vec3 frag_normal;
+out float frag_ao;
+
+void main() {
+#ifdef WATER
+	// Quarter of the water texture, flipped like the render targets tiles were once drawn through
+	vec2 tile = vec2(instanceTransform[0][3], instanceTransform[1][3]);
+	frag_texcoord = (tile + vec2(vertex_texcoord.x, 1.0 - vertex_texcoord.y)) * 0.5;
+#else
+	frag_texcoord = vertex_texcoord;
+#endif
+
+	// Bottom row only reaches w, dropped here
+	frag_worldpos = vec3(instanceTransform * vec4(vertex_position, 1.0));
+
+	// Instanced models are not meshed, no AO
+	frag_ao = 1.0;
+
+	// Instances only rotate about Y in 90 degree steps,
+	// rotation part is orthonormal and doubles as normal matrix
+	frag_normal = normalize(mat3(instanceTransform) * vertex_normal);
+
+	gl_Position = mvp * vec4(frag_worldpos, 1.0);
+}
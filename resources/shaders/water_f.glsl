@@ -0,0 +1,38 @@
+#version 330
+
+// Same as the CPU path of WaterUpdate, one fragment per output pixel,
+// keep in sync with water.h
+#define WATER_SIZE 512
+#define WATER_CODE_DARK 254.0
+#define WATER_CODE_LIGHT 255.0
+
+uniform sampler2D noise;	// water_noise.png, red channel
+
+uniform ivec2 scroll;
+uniform int offset;
+uniform float water_filter;
+
+// Output code, one channel target
+out vec4 final_color;
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	// Power of two size, masking wraps like the modulo on the CPU
+	ivec2 a = (pixel + scroll) & (WATER_SIZE - 1);
+	ivec2 b = (pixel + ivec2(offset - scroll.x, -scroll.y - offset)) & (WATER_SIZE - 1);
+
+	float noise_a = floor(texelFetch(noise, a, 0).r * 255.0 + 0.5);
+	float noise_b = floor(texelFetch(noise, b, 0).r * 255.0 + 0.5);
+
+	float val = clamp((noise_a + noise_b) * water_filter, 0.0, 255.0);
+	float intensity = val / 255.0;
+
+	// Gray value truncates like the float to byte cast
+	float code = floor(val);
+
+	if(intensity > 0.79) code = WATER_CODE_DARK;
+	if(intensity > 0.99) code = WATER_CODE_LIGHT;
+
+	final_color = vec4(code / 255.0);
+}
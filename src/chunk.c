@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "chunk.h"
+
+// Backing storage for the empty sentinel: a single air entry and all-zero indices
+static PaletteEntry empty_palette[1] = { { 0, 0 } };
+static uint64_t empty_indices[CHUNK_CELLS / 64] = { 0 };
+
+Chunk chunk_empty = {
+	.indices = empty_indices,
+	.palette = empty_palette,
+	.palette_count = 1,
+	.palette_cap = 1,
+	.solid_count = 0,
+	.bits = 1
+};
+
+// Number of 64 bit words needed to store every cell's index at given width
+static uint32_t IndexWordCount(uint8_t bits) {
+	return (CHUNK_CELLS * bits) / 64;
+}
+
+static uint16_t ChunkGetIndex(Chunk *chunk, uint16_t local_id) {
+	uint32_t bit = (uint32_t)local_id * chunk->bits;
+	uint64_t mask = (1ull << chunk->bits) - 1;
+
+	return (chunk->indices[bit >> 6] >> (bit & 63)) & mask;
+}
+
+static void ChunkSetIndex(Chunk *chunk, uint16_t local_id, uint16_t index) {
+	uint32_t bit = (uint32_t)local_id * chunk->bits;
+	uint64_t mask = (1ull << chunk->bits) - 1;
+
+	uint64_t *word = &chunk->indices[bit >> 6];
+	*word = (*word & ~(mask << (bit & 63))) | ((uint64_t)index << (bit & 63));
+}
+
+// Repack indices at a new width
+static void ChunkResize(Chunk *chunk, uint8_t bits) {
+	Chunk resized = *chunk;
+	resized.bits = bits;
+	resized.indices = calloc(IndexWordCount(bits), sizeof(uint64_t));
+
+	for(uint16_t i = 0; i < CHUNK_CELLS; i++)
+		ChunkSetIndex(&resized, i, ChunkGetIndex(chunk, i));
+
+	free(chunk->indices);
+	chunk->indices = resized.indices;
+	chunk->bits = bits;
+}
+
+// Drop palette entries no cell references anymore, air stays at index 0
+static void ChunkCompact(Chunk *chunk) {
+	uint16_t remap[1 << CHUNK_MAX_BITS];
+	uint8_t used[1 << CHUNK_MAX_BITS] = { 0 };
+
+	used[0] = 1;
+	for(uint16_t i = 0; i < CHUNK_CELLS; i++)
+		used[ChunkGetIndex(chunk, i)] = 1;
+
+	uint16_t count = 0;
+	for(uint16_t i = 0; i < chunk->palette_count; i++) {
+		if(!used[i]) continue;
+
+		remap[i] = count;
+		chunk->palette[count++] = chunk->palette[i];
+	}
+
+	for(uint16_t i = 0; i < CHUNK_CELLS; i++)
+		ChunkSetIndex(chunk, i, remap[ChunkGetIndex(chunk, i)]);
+
+	chunk->palette_count = count;
+}
+
+// Find palette entry for block, adding it if missing,
+// returns -1 if chunk cannot hold another distinct entry
+static int32_t ChunkPaletteIndex(Chunk *chunk, unsigned char data, uint8_t rotation) {
+	for(uint16_t i = 0; i < chunk->palette_count; i++) {
+		if(chunk->palette[i].data == data && chunk->palette[i].rotation == rotation)
+			return i;
+	}
+
+	// Widen indices when palette outgrows current width,
+	// try reclaiming unused entries first once at max width
+	if(chunk->palette_count >= (1 << chunk->bits)) {
+		if(chunk->bits < CHUNK_MAX_BITS)
+			ChunkResize(chunk, chunk->bits * 2);
+		else
+			ChunkCompact(chunk);
+
+		if(chunk->palette_count >= (1 << chunk->bits)) return -1;
+	}
+
+	if(chunk->palette_count >= chunk->palette_cap) {
+		chunk->palette_cap *= 2;
+		chunk->palette = realloc(chunk->palette, sizeof(PaletteEntry) * chunk->palette_cap);
+	}
+
+	chunk->palette[chunk->palette_count] = (PaletteEntry) { data, rotation };
+	return chunk->palette_count++;
+}
+
+// Allocate a new chunk filled with air
+Chunk *ChunkCreate() {
+	Chunk *chunk = malloc(sizeof(Chunk));
+
+	*chunk = (Chunk) {
+		.indices = calloc(IndexWordCount(1), sizeof(uint64_t)),
+		.palette = malloc(sizeof(PaletteEntry) * 2),
+		.palette_count = 1,
+		.palette_cap = 2,
+		.solid_count = 0,
+		.bits = 1
+	};
+
+	chunk->palette[0] = (PaletteEntry) { 0, 0 };
+
+	return chunk;
+}
+
+void ChunkFree(Chunk *chunk) {
+	// Sentinel is static, never free it
+	if(!chunk || chunk == &chunk_empty) return;
+
+	free(chunk->indices);
+	free(chunk->palette);
+	free(chunk);
+}
+
+unsigned char ChunkGetData(Chunk *chunk, uint16_t local_id) {
+	return chunk->palette[ChunkGetIndex(chunk, local_id)].data;
+}
+
+uint8_t ChunkGetRotation(Chunk *chunk, uint16_t local_id) {
+	return chunk->palette[ChunkGetIndex(chunk, local_id)].rotation;
+}
+
+void ChunkSetCell(Chunk *chunk, uint16_t local_id, unsigned char data, uint8_t rotation) {
+	// Air has no orientation, keep a single air entry
+	if(!data) rotation = 0;
+
+	int32_t index = ChunkPaletteIndex(chunk, data, rotation);
+	if(index < 0) {
+		printf("ERROR: chunk palette full, cell %d not set\n", local_id);
+		return;
+	}
+
+	unsigned char prev = ChunkGetData(chunk, local_id);
+
+	// Keep solid count in sync so empty chunks can be released
+	if(prev && !data) chunk->solid_count--;
+	if(!prev && data) chunk->solid_count++;
+
+	ChunkSetIndex(chunk, local_id, index);
+}
+
+// Resident size of chunk in bytes
+uint32_t ChunkMemoryUsage(Chunk *chunk) {
+	if(chunk == &chunk_empty) return 0;
+
+	return sizeof(Chunk) + IndexWordCount(chunk->bits) * sizeof(uint64_t) + chunk->palette_cap * sizeof(PaletteEntry);
+}
@@ -0,0 +1,53 @@
+#include <stdint.h>
+
+#ifndef CHUNK_H_
+#define CHUNK_H_
+
+// Chunk dimensions, cells per axis must be a power of two
+#define CHUNK_SHIFT		4
+#define CHUNK_SIZE		(1 << CHUNK_SHIFT)
+#define CHUNK_MASK		(CHUNK_SIZE - 1)
+#define CHUNK_CELLS		(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+// Largest palette index width in bits, 8 bits = 256 palette entries
+#define CHUNK_MAX_BITS	8
+
+// Block and rotation pair stored once per chunk,
+// cells reference entries by index
+typedef struct {
+	unsigned char data;
+	uint8_t rotation;
+
+} PaletteEntry;
+
+typedef struct {
+	// Bit-packed palette indices, 1, 2, 4 or 8 bits per cell,
+	// widths are powers of two so an index never straddles two words
+	uint64_t *indices;
+
+	// Local palette, entry 0 is always air
+	PaletteEntry *palette;
+
+	uint16_t palette_count;
+	uint16_t palette_cap;
+
+	uint16_t solid_count;	// Number of non-empty cells
+
+	uint8_t bits;			// Bits per index
+
+} Chunk;
+
+// Shared read-only chunk used for every unallocated (all air) region,
+// never written to, never freed
+extern Chunk chunk_empty;
+
+Chunk *ChunkCreate();
+void ChunkFree(Chunk *chunk);
+
+unsigned char ChunkGetData(Chunk *chunk, uint16_t local_id);
+uint8_t ChunkGetRotation(Chunk *chunk, uint16_t local_id);
+void ChunkSetCell(Chunk *chunk, uint16_t local_id, unsigned char data, uint8_t rotation);
+
+uint32_t ChunkMemoryUsage(Chunk *chunk);
+
+#endif
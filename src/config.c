@@ -5,6 +5,9 @@
 #include "raymath.h"
 
 #include "config.h"
+#include "jobs.h"
+#include "lights.h"
+#include "water.h"
 
 // Read configuration options from provided file
 void ConfigRead(Config *conf, char *path) {
@@ -70,6 +73,51 @@ void ConfigParseLine(Config *conf, char *line) {
 		else 
 			sscanf(val, "%f", &conf->refresh_rate);
 
+	} else if(streq(key, "worker_threads")) {
+		// Worker threads:
+		// if auto option provided, pick from core count
+		int threads = 0;
+		if(!streq(val, AUTO)) 
+			sscanf(val, "%d", &threads);
+
+		conf->worker_threads = Clamp(threads, 0, JOBS_MAX_THREADS);
+
+	} else if(streq(key, "lighting")) {
+		// Lighting path:
+		// forward, clustered, baked or deferred, clustered and deferred lift the forward light limit,
+		// baked precomputes static lighting of chunks
+		if(!strncmp(val, "clustered", 9))
+			conf->light_mode = LIGHTING_CLUSTERED;
+		else if(!strncmp(val, "baked", 5))
+			conf->light_mode = LIGHTING_BAKED;
+		else if(!strncmp(val, "deferred", 8))
+			conf->light_mode = LIGHTING_DEFERRED;
+		else
+			conf->light_mode = LIGHTING_FORWARD;
+
+	} else if(streq(key, "dither")) {
+		// Dither:
+		// on or off, noise added by light shaders to hide banding
+		conf->dither_off = !strncmp(val, "off", 3);
+
+	} else if(streq(key, "water")) {
+		// Water:
+		// gpu, cpu or cached, gpu draws the effect with a shader instead of uploading pixels,
+		// cached replays ticks computed on the first pass through the animation
+		if(!strncmp(val, "gpu", 3))
+			conf->water_mode = WATER_GPU;
+		else if(!strncmp(val, "cached", 6))
+			conf->water_mode = WATER_CACHED;
+		else
+			conf->water_mode = WATER_CPU;
+
+	} else if(streq(key, "water_cache_mb")) {
+		// Water cache budget:
+		// megabytes of frames for cached water, one frame is 256 KB, 128 holds the whole animation
+		int mb = 0;
+		sscanf(val, "%d", &mb);
+		conf->water_cache_mb = Clamp(mb, 0, UINT16_MAX);
+
 	} else if(streq(key, "level_path")) {
 		// Level Path:
 		// for testing purposes
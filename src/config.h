@@ -33,6 +33,21 @@ typedef struct {
 	unsigned int window_height;
 
 	uint8_t debug_flags;
+
+	// Worker threads for jobs, 0 picks from core count
+	uint8_t worker_threads;
+
+	// LIGHTING_MODES
+	uint8_t light_mode;
+
+	// Light shaders skip noise dither
+	uint8_t dither_off;
+
+	// WATER_MODES
+	uint8_t water_mode;
+
+	// Water cache budget in megabytes, 0 picks the default
+	uint16_t water_cache_mb;
 } Config;
 
 void ConfigRead(Config *conf, char *path);
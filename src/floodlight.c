@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "lights.h"
+#include "map.h"
+#include "mesher.h"
+#include "floodlight.h"
+
+// Neighbours sharing a face
+static const int8_t light_dirs[6][3] = {
+	{ -1, 0, 0 }, { 1, 0, 0 },
+	{ 0, -1, 0 }, { 0, 1, 0 },
+	{ 0, 0, -1 }, { 0, 0, 1 }
+};
+
+// No block glows yet, Light entries are the only sources
+uint8_t BlockLightEmission(unsigned char data) {
+	return 0;
+}
+
+uint8_t GridLightAt(Grid *grid, Coords coords) {
+	if(!CoordsInBounds(coords, grid)) return 0;
+
+	uint8_t *levels = grid->light_levels[ChunkIndex(coords, grid)];
+	if(!levels) return 0;
+
+	return levels[ChunkLocalId(coords, grid)];
+}
+
+// Dark chunks get their level table on first lit cell
+static void GridLightSet(Grid *grid, Coords coords, uint8_t level) {
+	uint8_t **levels = &grid->light_levels[ChunkIndex(coords, grid)];
+
+	if(!*levels) {
+		if(!level) return;
+		*levels = calloc(CHUNK_CELLS, sizeof(uint8_t));
+	}
+
+	(*levels)[ChunkLocalId(coords, grid)] = level;
+}
+
+// Brightest of block emission and light seeds at cell
+static uint8_t LightSourceAt(Grid *grid, Coords coords) {
+	uint8_t level = BlockLightEmission(GridDataAt(grid, coords));
+
+	for(int32_t i = 0; i < grid->light_seed_count; i++) {
+		LightNode *seed = &grid->light_seeds[i];
+
+		if(seed->coords.c != coords.c || seed->coords.r != coords.r || seed->coords.t != coords.t) continue;
+		if(seed->level > level) level = seed->level;
+	}
+
+	return level;
+}
+
+static void LightQueuePush(LightQueue *queue, Coords coords, uint8_t level) {
+	if(queue->count >= queue->cap) {
+		queue->cap = (queue->cap) ? queue->cap * 2 : 256;
+		queue->nodes = realloc(queue->nodes, sizeof(LightNode) * queue->cap);
+	}
+
+	queue->nodes[queue->count++] = (LightNode) { coords, level };
+}
+
+static bool LightQueuePop(LightQueue *queue, LightNode *node) {
+	if(queue->head >= queue->count) {
+		queue->head = queue->count = 0;
+		return false;
+	}
+
+	*node = queue->nodes[queue->head++];
+	return true;
+}
+
+static Coords LightNeighbour(Coords coords, int dir) {
+	return (Coords) { 
+		coords.c + light_dirs[dir][0],
+		coords.r + light_dirs[dir][1],
+		coords.t + light_dirs[dir][2]
+	};
+}
+
+void GridLightMarkCell(Grid *grid, Coords coords) {
+	// Darken whatever the cell carried, removal pass finds what it lit
+	uint8_t old = GridLightAt(grid, coords);
+	if(old) {
+		GridLightSet(grid, coords, 0);
+		LightQueuePush(&grid->light_remove, coords, old);
+	}
+
+	uint8_t source = LightSourceAt(grid, coords);
+	if(source) {
+		GridLightSet(grid, coords, source);
+		LightQueuePush(&grid->light_add, coords, source);
+	}
+
+	// Opened cells take light back in from their lit neighbours
+	if(BlockIsOpaque(GridDataAt(grid, coords))) return;
+
+	for(int dir = 0; dir < 6; dir++) {
+		Coords neighbour = LightNeighbour(coords, dir);
+		uint8_t level = GridLightAt(grid, neighbour);
+
+		if(level) LightQueuePush(&grid->light_add, neighbour, level);
+	}
+}
+
+void GridLightPropagate(Grid *grid) {
+	LightNode node;
+
+	// Removal: neighbours dimmer than a removed cell were lit by it and go dark too,
+	// brighter or equal ones have another source and spread back in
+	while(LightQueuePop(&grid->light_remove, &node)) {
+		for(int dir = 0; dir < 6; dir++) {
+			Coords neighbour = LightNeighbour(node.coords, dir);
+
+			uint8_t level = GridLightAt(grid, neighbour);
+			if(!level) continue;
+
+			if(level >= node.level) {
+				LightQueuePush(&grid->light_add, neighbour, level);
+				continue;
+			}
+
+			GridLightSet(grid, neighbour, 0);
+			LightQueuePush(&grid->light_remove, neighbour, level);
+
+			uint8_t source = LightSourceAt(grid, neighbour);
+			if(source) {
+				GridLightSet(grid, neighbour, source);
+				LightQueuePush(&grid->light_add, neighbour, source);
+			}
+		}
+	}
+
+	// Addition: spread into non-opaque neighbours that are at least two levels darker,
+	// levels are re-read since later removals or brighter paths may have changed them
+	while(LightQueuePop(&grid->light_add, &node)) {
+		uint8_t level = GridLightAt(grid, node.coords);
+		if(level <= 1) continue;
+
+		for(int dir = 0; dir < 6; dir++) {
+			Coords neighbour = LightNeighbour(node.coords, dir);
+			if(!CoordsInBounds(neighbour, grid)) continue;
+
+			if(GridLightAt(grid, neighbour) + 1 >= level) continue;
+			if(BlockIsOpaque(GridDataAt(grid, neighbour))) continue;
+
+			GridLightSet(grid, neighbour, level - 1);
+			LightQueuePush(&grid->light_add, neighbour, level - 1);
+		}
+	}
+}
+
+static bool LightSeedListed(LightNode *seeds, int32_t count, LightNode seed) {
+	for(int32_t i = 0; i < count; i++) {
+		LightNode *other = &seeds[i];
+
+		if(other->level == seed.level && other->coords.c == seed.coords.c && 
+			other->coords.r == seed.coords.r && other->coords.t == seed.coords.t) return true;
+	}
+
+	return false;
+}
+
+void GridSyncLightSeeds(Grid *grid, LightHandler *handler) {
+	if(grid->light_seed_version == handler->version) return;
+	grid->light_seed_version = handler->version;
+
+	// Enabled lights inside of grid, range in cells sets the level
+	LightNode seeds[MAX_LIGHTS];
+	int32_t count = 0;
+
+	for(int i = 0; i < handler->light_count; i++) {
+		Light *light = &handler->lights[i];
+		if(!light->enabled) continue;
+
+		Coords coords = Vec3ToCoords(light->position, grid);
+		if(!CoordsInBounds(coords, grid)) continue;
+
+		float level = Clamp(light->range / grid->cell_size, 1, LIGHT_LEVEL_MAX);
+		seeds[count++] = (LightNode) { coords, level + 0.5f };
+	}
+
+	LightNode old_seeds[MAX_LIGHTS];
+	int32_t old_count = grid->light_seed_count;
+
+	for(int32_t i = 0; i < old_count; i++)
+		old_seeds[i] = grid->light_seeds[i];
+
+	for(int32_t i = 0; i < count; i++)
+		grid->light_seeds[i] = seeds[i];
+
+	grid->light_seed_count = count;
+
+	// Relight only cells whose seeds came, went or changed level
+	for(int32_t i = 0; i < old_count; i++) {
+		if(!LightSeedListed(seeds, count, old_seeds[i])) 
+			GridLightMarkCell(grid, old_seeds[i].coords);
+	}
+
+	for(int32_t i = 0; i < count; i++) {
+		if(!LightSeedListed(old_seeds, old_count, seeds[i])) 
+			GridLightMarkCell(grid, seeds[i].coords);
+	}
+
+	GridLightPropagate(grid);
+}
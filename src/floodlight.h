@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include "raylib.h"
+#include "lights.h"
+#include "map.h"
+
+#ifndef FLOODLIGHT_H_
+#define FLOODLIGHT_H_
+
+// Light level a block emits by itself, 0 for none
+uint8_t BlockLightEmission(unsigned char data);
+
+// Flood fill level of cell, 0 outside of grid
+uint8_t GridLightAt(Grid *grid, Coords coords);
+
+// Queue relighting of a cell whose data changed, applied by GridLightPropagate
+void GridLightMarkCell(Grid *grid, Coords coords);
+
+// Drain removal then addition queues, cost scales with the area whose light changed
+void GridLightPropagate(Grid *grid);
+
+// Reseed cells of lights that changed since the last sync
+void GridSyncLightSeeds(Grid *grid, LightHandler *handler);
+
+#endif
@@ -0,0 +1,77 @@
+#include <math.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "frustum.h"
+
+static Vector4 PlaneNormalize(Vector4 p) {
+	float len = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+	return (Vector4) { p.x / len, p.y / len, p.z / len, p.w / len };
+}
+
+// Camera's combined view and projection, world to clip space
+Matrix FrustumViewProjection(Camera3D camera, float aspect, float near, float far) {
+	Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+	Matrix proj = MatrixPerspective(camera.fovy * DEG2RAD, aspect, near, far);
+
+	return MatrixMultiply(view, proj);
+}
+
+// Extract six planes from camera's view-projection matrix (Gribb/Hartmann)
+Frustum FrustumFromCamera(Camera3D camera, float aspect, float near, float far) {
+	Matrix m = FrustumViewProjection(camera, aspect, near, far);
+
+	// Rows of clip matrix, raylib stores columns contiguously
+	Vector4 row0 = (Vector4) { m.m0, m.m4, m.m8,  m.m12 };
+	Vector4 row1 = (Vector4) { m.m1, m.m5, m.m9,  m.m13 };
+	Vector4 row2 = (Vector4) { m.m2, m.m6, m.m10, m.m14 };
+	Vector4 row3 = (Vector4) { m.m3, m.m7, m.m11, m.m15 };
+
+	Frustum frustum = { 0 };
+	frustum.planes[PLANE_LEFT]   = PlaneNormalize(Vector4Add(row3, row0));
+	frustum.planes[PLANE_RIGHT]  = PlaneNormalize(Vector4Subtract(row3, row0));
+	frustum.planes[PLANE_BOTTOM] = PlaneNormalize(Vector4Add(row3, row1));
+	frustum.planes[PLANE_TOP]    = PlaneNormalize(Vector4Subtract(row3, row1));
+	frustum.planes[PLANE_NEAR]   = PlaneNormalize(Vector4Add(row3, row2));
+	frustum.planes[PLANE_FAR]    = PlaneNormalize(Vector4Subtract(row3, row2));
+
+	// Bounds from corners of the far plane and the camera position
+	Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+	Vector3 right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+	Vector3 up = Vector3CrossProduct(right, forward);
+
+	float half_h = tanf(camera.fovy * DEG2RAD * 0.5f) * far;
+	float half_w = half_h * aspect;
+	Vector3 far_center = Vector3Add(camera.position, Vector3Scale(forward, far));
+
+	frustum.min = camera.position;
+	frustum.max = camera.position;
+
+	for(int i = 0; i < 4; i++) {
+		float sx = (i & 1) ? 1 : -1;
+		float sy = (i & 2) ? 1 : -1;
+
+		Vector3 corner = Vector3Add(far_center, Vector3Add(Vector3Scale(right, sx * half_w), Vector3Scale(up, sy * half_h)));
+		frustum.min = Vector3Min(frustum.min, corner);
+		frustum.max = Vector3Max(frustum.max, corner);
+	}
+
+	return frustum;
+}
+
+// Classify an axis aligned box against the frustum
+uint8_t FrustumTestBox(Frustum *frustum, Vector3 min, Vector3 max) {
+	uint8_t result = FRUSTUM_INSIDE;
+
+	for(int i = 0; i < PLANE_COUNT; i++) {
+		Vector4 p = frustum->planes[i];
+
+		// Box corners furthest along and against the plane normal
+		Vector3 pos = (Vector3) { (p.x >= 0) ? max.x : min.x, (p.y >= 0) ? max.y : min.y, (p.z >= 0) ? max.z : min.z };
+		Vector3 neg = (Vector3) { (p.x >= 0) ? min.x : max.x, (p.y >= 0) ? min.y : max.y, (p.z >= 0) ? min.z : max.z };
+
+		if(p.x * pos.x + p.y * pos.y + p.z * pos.z + p.w < 0) return FRUSTUM_OUTSIDE;
+		if(p.x * neg.x + p.y * neg.y + p.z * neg.z + p.w < 0) result = FRUSTUM_INTERSECT;
+	}
+
+	return result;
+}
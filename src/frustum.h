@@ -0,0 +1,39 @@
+#include <stdint.h>
+#include "raylib.h"
+
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+
+enum FRUSTUM_PLANES : uint8_t {
+	PLANE_LEFT,
+	PLANE_RIGHT,
+	PLANE_BOTTOM,
+	PLANE_TOP,
+	PLANE_NEAR,
+	PLANE_FAR,
+	PLANE_COUNT
+};
+
+enum FRUSTUM_RESULTS : uint8_t {
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECT,
+	FRUSTUM_INSIDE
+};
+
+typedef struct {
+	// Plane normal in xyz pointing inwards, distance in w,
+	// points with dot(normal, p) + w >= 0 are inside
+	Vector4 planes[PLANE_COUNT];
+
+	// World space bounds of the frustum volume
+	Vector3 min;
+	Vector3 max;
+
+} Frustum;
+
+Matrix FrustumViewProjection(Camera3D camera, float aspect, float near, float far);
+Frustum FrustumFromCamera(Camera3D camera, float aspect, float near, float far);
+
+uint8_t FrustumTestBox(Frustum *frustum, Vector3 min, Vector3 max);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "jobs.h"
+
+pthread_t job_threads[JOBS_MAX_THREADS];
+uint8_t job_thread_count;
+
+pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t job_wake = PTHREAD_COND_INITIALIZER;	// Batch submitted or pool closing
+pthread_cond_t job_idle = PTHREAD_COND_INITIALIZER;	// Worker stopped using a batch
+
+// Pending batches, oldest first
+JobBatch *job_queue;
+
+bool jobs_running;
+
+// Claim and run items until none are left
+static void JobBatchRun(JobBatch *batch) {
+	int32_t i;
+	while((i = __atomic_fetch_add(&batch->claimed, 1, __ATOMIC_RELAXED)) < batch->count)
+		batch->func(batch->ctx, i);
+}
+
+// Remove batch from queue if still there, caller holds job_lock
+static void JobQueueRemove(JobBatch *batch) {
+	JobBatch **link = &job_queue;
+	while(*link && *link != batch)
+		link = &(*link)->next;
+
+	if(*link) *link = batch->next;
+}
+
+static void *JobWorker(void *arg) {
+	pthread_mutex_lock(&job_lock);
+
+	while(jobs_running) {
+		JobBatch *batch = job_queue;
+
+		if(!batch) {
+			pthread_cond_wait(&job_wake, &job_lock);
+			continue;
+		}
+
+		// Every item claimed already, nothing left for this worker
+		if(__atomic_load_n(&batch->claimed, __ATOMIC_RELAXED) >= batch->count) {
+			JobQueueRemove(batch);
+			continue;
+		}
+
+		batch->users++;
+		pthread_mutex_unlock(&job_lock);
+
+		JobBatchRun(batch);
+
+		pthread_mutex_lock(&job_lock);
+		batch->users--;
+		pthread_cond_broadcast(&job_idle);
+	}
+
+	pthread_mutex_unlock(&job_lock);
+	return NULL;
+}
+
+void JobsInit(uint8_t thread_count) {
+	if(!thread_count) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = (cores > 1) ? cores - 1 : 0;
+	}
+
+	if(thread_count > JOBS_MAX_THREADS) thread_count = JOBS_MAX_THREADS;
+
+	jobs_running = true;
+	job_thread_count = 0;
+
+	for(uint8_t i = 0; i < thread_count; i++) {
+		if(pthread_create(&job_threads[i], NULL, JobWorker, NULL)) {
+			printf("ERROR: could not start worker thread %d\n", i);
+			break;
+		}
+
+		job_thread_count++;
+	}
+}
+
+void JobsClose() {
+	pthread_mutex_lock(&job_lock);
+	jobs_running = false;
+	pthread_cond_broadcast(&job_wake);
+	pthread_mutex_unlock(&job_lock);
+
+	for(uint8_t i = 0; i < job_thread_count; i++)
+		pthread_join(job_threads[i], NULL);
+
+	job_thread_count = 0;
+}
+
+uint8_t JobsThreadCount() {
+	return job_thread_count;
+}
+
+void JobsSubmit(JobBatch *batch, JobFunc func, void *ctx, int32_t count) {
+	*batch = (JobBatch) {
+		.func = func,
+		.ctx = ctx,
+		.count = count
+	};
+
+	// Without workers everything runs in JobsWait
+	if(!job_thread_count || count <= 0) return;
+
+	pthread_mutex_lock(&job_lock);
+
+	JobBatch **link = &job_queue;
+	while(*link)
+		link = &(*link)->next;
+
+	*link = batch;
+
+	pthread_cond_broadcast(&job_wake);
+	pthread_mutex_unlock(&job_lock);
+}
+
+void JobsWait(JobBatch *batch) {
+	JobBatchRun(batch);
+
+	if(!job_thread_count) return;
+
+	// No new workers can pick up batch once it leaves the queue,
+	// wait for the ones still finishing their items
+	pthread_mutex_lock(&job_lock);
+	JobQueueRemove(batch);
+
+	while(batch->users)
+		pthread_cond_wait(&job_idle, &job_lock);
+
+	pthread_mutex_unlock(&job_lock);
+}
+
+void JobsParallelFor(JobFunc func, void *ctx, int32_t count) {
+	JobBatch batch;
+	JobsSubmit(&batch, func, ctx, count);
+	JobsWait(&batch);
+}
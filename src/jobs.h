@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#define JOBS_MAX_THREADS	16
+
+// Runs one item of a batch, index is in [0, count)
+typedef void (*JobFunc)(void *ctx, int32_t index);
+
+// A set of independent items run by the worker pool,
+// owned by the caller and must stay alive until JobsWait returns
+typedef struct JobBatch {
+	JobFunc func;
+	void *ctx;
+
+	int32_t count;
+	int32_t claimed;	// Next item to run, updated atomically
+	int32_t users;		// Workers currently running items
+
+	struct JobBatch *next;
+
+} JobBatch;
+
+// Start worker threads, 0 picks one less than the number of cores
+void JobsInit(uint8_t thread_count);
+void JobsClose();
+
+uint8_t JobsThreadCount();
+
+// Queue batch and return immediately
+void JobsSubmit(JobBatch *batch, JobFunc func, void *ctx, int32_t count);
+
+// Help run remaining items of batch, return once all of them finished
+void JobsWait(JobBatch *batch);
+
+// Submit and wait in one call
+void JobsParallelFor(JobFunc func, void *ctx, int32_t count);
+
+#endif
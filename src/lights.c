@@ -4,23 +4,61 @@
 #include "raylib.h"
 #include "raymath.h"
 #include "lights.h"
+#include "render.h"
+#include "shaders.h"
 
 Color LIGHT_COLOR_DEFAULT;
 
-int enabled_loc;
-int positions_loc;
-int colors_loc;
-int ranges_loc;
-int count_loc;
-int time_loc;
-int ambient_loc;
+// Shaders sharing the light uniforms
+enum LIGHT_SHADERS : uint8_t {
+	LSHADER_DEFAULT,	// Models, every forward light
+	LSHADER_INSTANCED,
+	LSHADER_WATER,		// Instanced water tiles
+	LSHADER_BAKED,		// Baked chunks, light from vertex colors
+	LSHADER_LIGHTS_0,	// Forward chunks, loops unrolled for up to 0, 1, 2, 4 and 8 lights
+	LSHADER_LIGHTS_1,
+	LSHADER_LIGHTS_2,
+	LSHADER_LIGHTS_4,
+	LSHADER_LIGHTS_8,
+	LSHADER_COUNT
+};
+
+// Size of the draw light list each shader is compiled for, -1 loops to a uniform count instead,
+// models and instances see every light so a fixed loop would always run the full 16
+const int light_buckets[LSHADER_COUNT] = { -1, -1, -1, 0, 0, 1, 2, 4, 8 };
+
+// Zero id until first use, variants compile lazily
+Shader light_shaders[LSHADER_COUNT];
+
+int positions_loc[LSHADER_COUNT];
+int colors_loc[LSHADER_COUNT];
+int ranges_loc[LSHADER_COUNT];
+int time_loc[LSHADER_COUNT];
+int ambient_loc[LSHADER_COUNT];
+int mat_model_loc[LSHADER_COUNT];
+int mat_normal_loc[LSHADER_COUNT];
+int draw_lights_loc[LSHADER_COUNT];
+int draw_light_count_loc[LSHADER_COUNT];
+
+// Enabled forward lights, the draw list of draws not restricted to a subset
+int32_t forward_lights[MAX_FORWARD_LIGHTS];
+int forward_light_count;
+
+// Model matrix changes rarely between draws, skip repeated uploads
+UniformCache uniform_cache[LSHADER_COUNT];
 
 float ent_light_timer = 0.0f;
 
-Shader light_shader;
 LightHandler *lh;
 
+static void UploadLightsTo(LightHandler *handler, int s);
+
 void MakeLight(int type, float range, Vector3 position, Color color, LightHandler *handler) {
+	if(handler->light_count >= MAX_LIGHTS) {
+		printf("ERROR: light limit of %d reached, light not created\n", MAX_LIGHTS);
+		return;
+	}
+
 	Light *light = &handler->lights[handler->light_count++];
 	light->flags = 0;
 	light->type = type;
@@ -28,22 +66,84 @@ void MakeLight(int type, float range, Vector3 position, Color color, LightHandle
 	light->position = position;
 	light->color = color;
 	light->enabled = 1;
+
+	handler->flags |= LIGHTS_DIRTY;
 }
 
-void DeleteLight(LightHandler *handler, uint8_t id) {
-	if(id >= handler->light_count) return;
+void DeleteLight(LightHandler *handler, int id) {
+	if(id < 0 || id >= handler->light_count) return;
 
-	for(uint8_t i = id; i < handler->light_count - 1; i++) 
+	for(int i = id; i < handler->light_count - 1; i++) 
 		handler->lights[i] = handler->lights[i + 1];
 
 	handler->light_count--;
+	handler->flags |= LIGHTS_DIRTY;
 
-	for(uint8_t i = 0; i < handler->light_count; i++)
+	for(int i = 0; i < handler->light_count; i++)
 		handler->lights[i].flags &= ~LIGHT_SELECTED;
 
 	handler->selected_id = -1;
 }
 
+// Compile shader s for current mode and resolve its uniforms, lights are uploaded
+// right away when the shader is requested after the first upload
+static void LoadLightShader(LightHandler *handler, int s) {
+	// Clustered path walks per-cluster light lists instead of every light,
+	// deferred path only fills the G-buffer and lights it afterwards
+	char *fragment_path = "resources/shaders/light_f.glsl";
+
+	if(handler->mode == LIGHTING_CLUSTERED)
+		fragment_path = "resources/shaders/light_clustered_f.glsl";
+	else if(handler->mode == LIGHTING_DEFERRED)
+		fragment_path = "resources/shaders/gbuffer_f.glsl";
+
+	// Instancing variants, raylib feeds per-instance matrices through this attribute
+	bool instanced = (s == LSHADER_INSTANCED || s == LSHADER_WATER);
+	char *vertex_path = (instanced) ? 
+		"resources/shaders/light_instanced_v.glsl" : "resources/shaders/light_v.glsl";
+
+	char light_count[32] = "";
+	if(light_buckets[s] >= 0) snprintf(light_count, sizeof(light_count), "#define LIGHT_COUNT %d\n", light_buckets[s]);
+
+	const char *defines = TextFormat("%s%s%s%s", light_count,
+		(s == LSHADER_BAKED) ? "#define BAKED\n" : "",
+		(s == LSHADER_WATER) ? "#define WATER\n" : "",
+		(handler->flags & LIGHTS_NO_DITHER) ? "" : "#define DITHER\n");
+
+	Shader shader = LoadShaderVariant(vertex_path, fragment_path, defines);
+
+	if(instanced)
+		shader.locs[SHADER_LOC_VERTEX_INSTANCE_TX] = GetShaderLocationAttrib(shader, "instanceTransform");
+
+	positions_loc[s] 	= GetShaderLocation(shader, "light_positions");
+	colors_loc[s] 		= GetShaderLocation(shader, "light_colors");
+	ranges_loc[s] 		= GetShaderLocation(shader, "light_ranges");
+	time_loc[s] 		= GetShaderLocation(shader, "time");
+	ambient_loc[s] 		= GetShaderLocation(shader, "ambient");
+	mat_model_loc[s] 	= GetShaderLocation(shader, "mat_model");
+	mat_normal_loc[s] 	= GetShaderLocation(shader, "mat_normal");
+	draw_lights_loc[s] 	= GetShaderLocation(shader, "draw_lights");
+	draw_light_count_loc[s] = GetShaderLocation(shader, "draw_light_count");
+
+	UniformCacheReset(&uniform_cache[s]);
+
+	Vector4 diffuse = (Vector4){ 0.55f, 0.15f, 0.15f, 1.0f };
+	SetShaderValue(shader, GetShaderLocation(shader, "col_diffuse"), &diffuse, SHADER_UNIFORM_VEC4);
+
+	light_shaders[s] = shader;
+
+	if(handler->version) UploadLightsTo(handler, s);
+}
+
+// Slot of a light shader, -1 for other shaders
+static int LightShaderSlot(Shader shader) {
+	for(int s = 0; s < LSHADER_COUNT; s++) {
+		if(light_shaders[s].id && light_shaders[s].id == shader.id) return s;
+	}
+
+	return -1;
+}
+
 void InitLights(LightHandler *handler) {
 	lh = handler;
 
@@ -51,21 +151,22 @@ void InitLights(LightHandler *handler) {
 	//LIGHT_COLOR_DEFAULT = ColorBrightness(BEIGE, -0.25f);
 	LIGHT_COLOR_DEFAULT = ColorBrightness(BEIGE, 0.25f);
 
-	handler->shader = LoadShader(
-		TextFormat("resources/shaders/light_v.glsl"),
-		TextFormat("resources/shaders/light_f.glsl")
-		//TextFormat("shaders/debug_f.glsl")
-	);
-
-	light_shader = handler->shader;
-	
-	enabled_loc 	= GetShaderLocation(handler->shader, "light_enabled");
-	positions_loc 	= GetShaderLocation(handler->shader, "light_positions");
-	colors_loc 		= GetShaderLocation(handler->shader, "light_colors");
-	ranges_loc 		= GetShaderLocation(handler->shader, "light_ranges");
-	count_loc 		= GetShaderLocation(handler->shader, "light_count");
-	time_loc 		= GetShaderLocation(handler->shader, "time");
-	ambient_loc 	= GetShaderLocation(handler->shader, "ambient");
+	for(int s = 0; s < LSHADER_COUNT; s++)
+		light_shaders[s] = (Shader) { 0 };
+
+	LoadLightShader(handler, LSHADER_DEFAULT);
+	LoadLightShader(handler, LSHADER_INSTANCED);
+	LoadLightShader(handler, LSHADER_WATER);
+
+	handler->shader = light_shaders[LSHADER_DEFAULT];
+	handler->shader_instanced = light_shaders[LSHADER_INSTANCED];
+	handler->shader_water = light_shaders[LSHADER_WATER];
+
+	// Chunk meshes skip lighting math, it is baked into their vertex colors
+	if(handler->mode == LIGHTING_BAKED) {
+		LoadLightShader(handler, LSHADER_BAKED);
+		handler->shader_baked = light_shaders[LSHADER_BAKED];
+	}
 
 	// Static lights
 	/*
@@ -78,40 +179,18 @@ void InitLights(LightHandler *handler) {
 
 	//MakeLight(LIGHT_PLAYER, 10.0f, Vector3Zero(), LIGHT_COLOR_DEFAULT, handler);
 
-	int enabled[MAX_LIGHTS];
-	Vector3 positions[MAX_LIGHTS];
-	Vector3 colors[MAX_LIGHTS];
-	float ranges[MAX_LIGHTS];
-
 	Color ambient_color = ColorBrightness(WHITE, -0.75f);
-	Vector3 ambient = ColorQuantized(ambient_color);
-	handler->ambient_color = ambient;
+	handler->ambient_color = ColorQuantized(ambient_color);
 
-	for(int i = 0; i < handler->light_count; i++) {
-		enabled[i] = 1;	
-		positions[i] = handler->lights[i].position;
+	if(handler->mode == LIGHTING_CLUSTERED)
+		InitLightClusters(handler);
 
-		colors[i] = (Vector3) {
-			handler->lights[i].color.r / 255.0f,
-			handler->lights[i].color.g / 255.0f,
-			handler->lights[i].color.b / 255.0f
-		};
-		
-		ranges[i] = handler->lights[i].range;
-	}
+	if(handler->mode == LIGHTING_DEFERRED)
+		InitGBuffer(handler);
 
-	int count = handler->light_count;
-	
-	SetShaderValueV(handler->shader, enabled_loc, enabled, SHADER_UNIFORM_INT, count);
-	SetShaderValueV(handler->shader, positions_loc, positions, SHADER_UNIFORM_VEC3, count);
-	SetShaderValueV(handler->shader, colors_loc, colors, SHADER_UNIFORM_VEC3, count);
-	SetShaderValueV(handler->shader, ranges_loc, ranges, SHADER_UNIFORM_FLOAT, count);
-	SetShaderValue(handler->shader, count_loc, &count, SHADER_UNIFORM_INT);
-	SetShaderValue(handler->shader, ambient_loc, &ambient, SHADER_UNIFORM_VEC3);
+	// Upload light arrays on first update
+	handler->flags |= LIGHTS_DIRTY;
 
-	Vector4 diffuse = (Vector4){ 0.55f, 0.15f, 0.15f, 1.0f };
-	SetShaderValue(handler->shader, GetShaderLocation(handler->shader, "col_diffuse"), &diffuse, SHADER_UNIFORM_VEC4);
-	
 	handler->selected_id = -1;
 
 	printf("light count: %d\n", handler->light_count);
@@ -120,41 +199,164 @@ void InitLights(LightHandler *handler) {
 	}
 }
 
+// Upload ambient and forward light arrays to one shader
+static void UploadLightsTo(LightHandler *handler, int s) {
+	Shader shader = light_shaders[s];
+
+	SetShaderValue(shader, ambient_loc[s], &handler->ambient_color, SHADER_UNIFORM_VEC3);
+
+	// Clustered shaders read lights from a texture, deferred passes set each light's uniforms as they draw it
+	if(handler->mode == LIGHTING_CLUSTERED || handler->mode == LIGHTING_DEFERRED) return;
+
+	Vector3 positions[MAX_FORWARD_LIGHTS];
+	Vector3 colors[MAX_FORWARD_LIGHTS];
+	float ranges[MAX_FORWARD_LIGHTS];
+
+	// Forward shaders only hold the first MAX_FORWARD_LIGHTS
+	int count = handler->light_count;
+	if(count > MAX_FORWARD_LIGHTS) count = MAX_FORWARD_LIGHTS;
+
+	for(int i = 0; i < count; i++) {
+		positions[i] = handler->lights[i].position;
+		colors[i] = ColorQuantized(handler->lights[i].color);
+		ranges[i] = handler->lights[i].range;
+	}
+
+	if(count) {
+		SetShaderValueV(shader, positions_loc[s], positions, SHADER_UNIFORM_VEC3, count);
+		SetShaderValueV(shader, colors_loc[s], colors, SHADER_UNIFORM_VEC3, count);
+		SetShaderValueV(shader, ranges_loc[s], ranges, SHADER_UNIFORM_FLOAT, count);
+	}
+
+	// Models and instanced draws span many chunks, they see every light unless a draw narrows it
+	if(light_buckets[s] < 0) SetDrawLights(shader, NULL, 0);
+}
+
+// Upload every light array once per loaded shader
+static void UploadLights(LightHandler *handler) {
+	// Draw lists only hold enabled lights, shaders skip the enabled check
+	int count = handler->light_count;
+	if(count > MAX_FORWARD_LIGHTS) count = MAX_FORWARD_LIGHTS;
+
+	forward_light_count = 0;
+
+	for(int i = 0; i < count; i++) {
+		if(handler->lights[i].enabled) forward_lights[forward_light_count++] = i;
+	}
+
+	for(int s = 0; s < LSHADER_COUNT; s++) {
+		if(light_shaders[s].id) UploadLightsTo(handler, s);
+	}
+
+	if(handler->mode == LIGHTING_CLUSTERED)
+		LightClustersUploadLights(handler);
+}
+
 void UpdateLights(LightHandler *handler) {
 	float time = GetTime();
-	SetShaderValue(handler->shader, time_loc, &time, SHADER_UNIFORM_FLOAT);
 
-	int enabled[handler->light_count];
-	Vector3 positions[handler->light_count];
-	float ranges[handler->light_count];
-	Vector3 colors[handler->light_count];
-	
-	SetShaderValue(handler->shader, count_loc, &handler->light_count, SHADER_UNIFORM_INT);
+	for(int s = 0; s < LSHADER_COUNT; s++) {
+		if(light_shaders[s].id) SetShaderValue(light_shaders[s], time_loc[s], &time, SHADER_UNIFORM_FLOAT);
+	}
 
-	for(int i = 0; i < handler->light_count; i++) {
-		// Set on/off
-		enabled[i] = handler->lights[i].enabled;
-		SetShaderValueV(handler->shader, enabled_loc, enabled, SHADER_UNIFORM_INT, handler->light_count);
+	// Light arrays only change through MakeLight, DeleteLight and the LightSet functions
+	if(!(handler->flags & LIGHTS_DIRTY)) return;
 
-		// Set positions
-		positions[i] = handler->lights[i].position;
-		SetShaderValueV(handler->shader, positions_loc, positions, SHADER_UNIFORM_VEC3, handler->light_count);
+	UploadLights(handler);
+	handler->flags &= ~LIGHTS_DIRTY;
+	handler->version++;
+}
 
-		// Set ranges
-		ranges[i] = handler->lights[i].range;		
-		SetShaderValueV(handler->shader, ranges_loc, ranges, SHADER_UNIFORM_FLOAT, handler->light_count);
+// Enabled forward lights whose range reaches into box, returns count written to ids
+int LightsInBox(LightHandler *handler, Vector3 min, Vector3 max, int32_t *ids) {
+	int count = 0;
 
-		colors[i] = ColorQuantized(handler->lights[i].color);
-		SetShaderValueV(handler->shader, colors_loc, colors, SHADER_UNIFORM_VEC3, handler->light_count);
+	for(int i = 0; i < forward_light_count; i++) {
+		Light *light = &handler->lights[forward_lights[i]];
+
+		// Squared distance from light to nearest point of box
+		Vector3 nearest = Vector3Clamp(light->position, min, max);
+		float range = light->range * LIGHT_RANGE_SCALE;
+
+		if(Vector3DistanceSqr(nearest, light->position) < range * range)
+			ids[count++] = forward_lights[i];
+	}
+
+	return count;
+}
+
+// Forward shader compiled for the smallest light list holding count lights
+Shader LightShaderForCount(LightHandler *handler, int count) {
+	int s = LSHADER_LIGHTS_0;
+	while(s < LSHADER_LIGHTS_8 && light_buckets[s] < count) s++;
+
+	// Past the largest bucket, the default shader holds every forward light
+	if(light_buckets[s] < count) s = LSHADER_DEFAULT;
+
+	if(!light_shaders[s].id) LoadLightShader(handler, s);
+
+	return light_shaders[s];
+}
+
+// Restrict a light shader to listed lights for following draws, NULL lists every forward light
+void SetDrawLights(Shader shader, const int32_t *lights, int count) {
+	int s = LightShaderSlot(shader);
+	if(s < 0 || !light_buckets[s]) return;
+
+	if(!lights) {
+		lights = forward_lights;
+		count = forward_light_count;
 	}
+
+	if(light_buckets[s] < 0) {
+		if(count) UniformCacheSetV(&uniform_cache[s], shader, draw_lights_loc[s], lights, SHADER_UNIFORM_INT, count);
+		UniformCacheSet(&uniform_cache[s], shader, draw_light_count_loc[s], &count, SHADER_UNIFORM_INT);
+		return;
+	}
+
+	// Unrolled shaders loop over the whole array, pad with -1
+	int32_t padded[MAX_FORWARD_LIGHTS];
+	for(int n = 0; n < light_buckets[s]; n++)
+		padded[n] = (n < count) ? lights[n] : -1;
+
+	UniformCacheSetV(&uniform_cache[s], shader, draw_lights_loc[s], padded, SHADER_UNIFORM_INT, light_buckets[s]);
+}
+
+// Edits of lights, queue upload for next update
+void LightSetPosition(LightHandler *handler, int id, Vector3 position) {
+	if(id < 0 || id >= handler->light_count) return;
+
+	handler->lights[id].position = position;
+	handler->flags |= LIGHTS_DIRTY;
+}
+
+void LightSetColor(LightHandler *handler, int id, Color color) {
+	if(id < 0 || id >= handler->light_count) return;
+
+	handler->lights[id].color = color;
+	handler->flags |= LIGHTS_DIRTY;
+}
+
+void LightSetRange(LightHandler *handler, int id, float range) {
+	if(id < 0 || id >= handler->light_count) return;
+
+	handler->lights[id].range = range;
+	handler->flags |= LIGHTS_DIRTY;
+}
+
+void LightSetEnabled(LightHandler *handler, int id, bool enabled) {
+	if(id < 0 || id >= handler->light_count) return;
+
+	handler->lights[id].enabled = enabled;
+	handler->flags |= LIGHTS_DIRTY;
 }
 
 void DrawModelShaded(Model model, Vector3 position) {
 	//BeginShaderMode(light_shader);
 	Matrix mat = model.transform;
 	mat = MatrixTranslate(position.x, position.y, position.z);	
-	int mat_model_loc = GetShaderLocation(light_shader, "mat_model");
-	SetShaderValueMatrix(light_shader, mat_model_loc, mat);
+	UniformCacheSetMatrix(&uniform_cache[LSHADER_DEFAULT], light_shaders[LSHADER_DEFAULT], mat_model_loc[LSHADER_DEFAULT], mat);
+	UniformCacheSetMatrix(&uniform_cache[LSHADER_DEFAULT], light_shaders[LSHADER_DEFAULT], mat_normal_loc[LSHADER_DEFAULT], MatrixIdentity());
 
 	DrawModel(model, position, 1.0f, WHITE);
 	//EndShaderMode();
@@ -167,14 +369,25 @@ void DrawModelShadedEx(Model model, Vector3 position, Vector3 forward, float ang
 	mat = MatrixRotateY(angle * DEG2RAD);
 	mat = MatrixMultiply(mat, MatrixTranslate(position.x, position.y, position.z));
 
-	int mat_model_loc = GetShaderLocation(light_shader, "mat_model");
-	SetShaderValueMatrix(light_shader, mat_model_loc, mat);
+	UniformCacheSetMatrix(&uniform_cache[LSHADER_DEFAULT], light_shaders[LSHADER_DEFAULT], mat_model_loc[LSHADER_DEFAULT], mat);
+	UniformCacheSetMatrix(&uniform_cache[LSHADER_DEFAULT], light_shaders[LSHADER_DEFAULT], mat_normal_loc[LSHADER_DEFAULT], NormalMatrix(mat));
 
 	DrawModelEx(model, position, (Vector3) { 0, 1, 0 }, angle, Vector3One(), WHITE);
 	//EndShaderMode();
 }
 
-void DrawLightGizmos(LightHandler *handler, uint8_t id) {
+void DrawMeshShaded(Mesh mesh, Material material, Matrix transform) {
+	int s = LightShaderSlot(material.shader);
+
+	if(s >= 0) {
+		UniformCacheSetMatrix(&uniform_cache[s], material.shader, mat_model_loc[s], transform);
+		UniformCacheSetMatrix(&uniform_cache[s], material.shader, mat_normal_loc[s], NormalMatrix(transform));
+	}
+
+	DrawMesh(mesh, material, transform);
+}
+
+void DrawLightGizmos(LightHandler *handler, int id) {
 	Light *light = &handler->lights[id];
 
 	DrawSphere(light->position, 0.5f, ColorAlpha(light->color, 0.95f));
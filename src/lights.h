@@ -4,15 +4,44 @@
 #include <stdint.h>
 #include "raylib.h"
 
-#define MAX_LIGHTS 16 
+#define MAX_LIGHTS 256
+
+// Forward path uploads lights as uniform arrays of this size, see light_f.glsl
+#define MAX_FORWARD_LIGHTS 16
+
+// Breathing in the light shaders grows ranges by up to 5%
+#define LIGHT_RANGE_SCALE 1.05f
 
 #define LIGHT_SELECTED	0x01
 
+// Handler flags
+#define LIGHTS_DIRTY		0x01	// Light arrays changed since last upload
+#define LIGHTS_NO_DITHER	0x02	// Shaders compiled without noise dither, set before InitLights
+
 typedef enum : uint8_t {
 	LIGHT_DEFAULT 	= 0,
 
 } LIGHT_TYPE;
 
+enum LIGHTING_MODES : uint8_t {
+	LIGHTING_FORWARD,	// Every fragment loops over all lights
+	LIGHTING_CLUSTERED,	// Fragments loop over lights binned into their view space cluster
+	LIGHTING_BAKED,		// Chunk meshes carry lighting in vertex colors, other models use forward
+	LIGHTING_DEFERRED	// Scene drawn to a G-buffer, each light shades only pixels its volume covers
+};
+
+// View space cluster grid, screen tiles by exponential depth slices,
+// keep in sync with light_clustered_f.glsl
+#define CLUSTER_X			16
+#define CLUSTER_Y			9
+#define CLUSTER_Z			24
+#define CLUSTER_COUNT		(CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// Light index list texture, width by height indices
+#define CLUSTER_INDEX_WIDTH		512
+#define CLUSTER_INDEX_HEIGHT	128
+#define CLUSTER_MAX_INDICES		(CLUSTER_INDEX_WIDTH * CLUSTER_INDEX_HEIGHT)
+
 typedef struct {
 	Color color;
 
@@ -28,29 +57,108 @@ typedef struct {
 
 } Light;
 
+// Per-frame light binning, uploaded as float textures bound through material maps
+typedef struct {
+	Texture2D light_data;	// Per light, row 0 position and range, row 1 color
+	Texture2D grid;			// Per cluster, offset and count into index list
+	Texture2D indices;		// Light indices of all clusters back to back
+
+	float *grid_px;
+	float *index_px;
+
+	int32_t *counts;
+
+	float near;
+	float far;
+
+} LightClusters;
+
+// Light volumes are low poly spheres, grown so their faces enclose the true range
+#define DEFERRED_VOLUME_PADDING	1.1f
+
+// Deferred path render targets and passes
+typedef struct {
+	unsigned int framebuffer;
+
+	unsigned int position;	// World position, RGBA32F
+	unsigned int normal;	// World normal, RGBA16F, zero where nothing was drawn
+	unsigned int albedo;	// Texture color, alpha holds AO
+	unsigned int depth;		// D24S8 renderbuffer, blitted to screen after lighting
+
+	Shader ambient;			// Full screen ambient term
+	Shader volume;			// Per light, drawn on light sphere
+
+	// Binds G-buffer textures to volume shader through DrawMesh
+	Material volume_material;
+	Mesh sphere;
+
+	int width;
+	int height;
+
+} GBuffer;
+
 typedef struct {
 	Light lights[MAX_LIGHTS];
 	Shader shader;
+	Shader shader_instanced;	// Same lighting, model matrix per instance
+	Shader shader_water;		// Instanced water, decodes the water texture, tile in each matrix
+	Shader shader_baked;		// Light from vertex colors, baked path only
 
 	Vector3 ambient_color;
 
+	LightClusters clusters;
+	GBuffer gbuffer;
+
 	int light_count;
 
 	int selected_id;
 
+	// Bumped on every upload of changed lights
+	uint32_t version;
+
+	uint8_t flags;
+	uint8_t mode;	// LIGHTING_MODES, set before InitLights
+
 } LightHandler;
 
 void MakeLight(int type, float range, Vector3 position, Color color, LightHandler *handler);
-void DeleteLight(LightHandler *handler, uint8_t id);
+void DeleteLight(LightHandler *handler, int id);
 
 void InitLights(LightHandler *handler);
 void UpdateLights(LightHandler *handler);
 void LoadLights(LightHandler *handler, char *file_path);
 
+void LightSetPosition(LightHandler *handler, int id, Vector3 position);
+void LightSetColor(LightHandler *handler, int id, Color color);
+void LightSetRange(LightHandler *handler, int id, float range);
+void LightSetEnabled(LightHandler *handler, int id, bool enabled);
+
+// Per-draw light lists for the forward path
+int LightsInBox(LightHandler *handler, Vector3 min, Vector3 max, int32_t *ids);
+Shader LightShaderForCount(LightHandler *handler, int count);
+void SetDrawLights(Shader shader, const int32_t *lights, int count);
+
 void DrawModelShaded(Model model, Vector3 position);
 void DrawModelShadedEx(Model model, Vector3 position, Vector3 forward, float angle);
+void DrawMeshShaded(Mesh mesh, Material material, Matrix transform);
+
+// Clustered path, see lights_clustered.c
+void InitLightClusters(LightHandler *handler);
+void UpdateLightClusters(LightHandler *handler, Camera3D camera, float far);
+void LightClustersBindMaterial(LightHandler *handler, Material *material);
+void LightClustersUploadLights(LightHandler *handler);
+
+// Baked path, see lights_baked.c
+int BakedLightsInBox(LightHandler *handler, Vector3 min, Vector3 max, int32_t *ids);
+uint32_t BakedLightsHash(LightHandler *handler, const int32_t *lights, int count);
+void BakeVertexLights(LightHandler *handler, const int32_t *lights, int count, Mesh *mesh);
+
+// Deferred path, see lights_deferred.c
+void InitGBuffer(LightHandler *handler);
+void BeginGBuffer(LightHandler *handler);
+void EndGBuffer(LightHandler *handler, Camera3D camera);
 
-void DrawLightGizmos(LightHandler *handler, uint8_t id);
+void DrawLightGizmos(LightHandler *handler, int id);
 
 Vector3 ColorQuantized(Color color);
 
@@ -0,0 +1,92 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "lights.h"
+
+// Vertex colors hold half the light so overbright up to 2x survives, baked_v.glsl scales back
+#define BAKE_SCALE	0.5f
+
+// Enabled lights, forward limit does not apply, whose range reaches into box
+int BakedLightsInBox(LightHandler *handler, Vector3 min, Vector3 max, int32_t *ids) {
+	int count = 0;
+
+	for(int i = 0; i < handler->light_count; i++) {
+		Light *light = &handler->lights[i];
+		if(!light->enabled) continue;
+
+		// Baked lights do not breathe, plain range is enough
+		Vector3 nearest = Vector3Clamp(light->position, min, max);
+
+		if(Vector3DistanceSqr(nearest, light->position) < light->range * light->range)
+			ids[count++] = i;
+	}
+
+	return count;
+}
+
+static uint32_t HashBytes(uint32_t hash, const void *data, size_t size) {
+	const unsigned char *bytes = data;
+
+	// FNV-1a
+	for(size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// Hash of everything a bake depends on, equal hashes let a chunk keep its colors
+uint32_t BakedLightsHash(LightHandler *handler, const int32_t *lights, int count) {
+	uint32_t hash = HashBytes(2166136261u, &handler->ambient_color, sizeof(Vector3));
+
+	for(int n = 0; n < count; n++) {
+		Light *light = &handler->lights[lights[n]];
+
+		hash = HashBytes(hash, &lights[n], sizeof(int32_t));
+		hash = HashBytes(hash, &light->position, sizeof(Vector3));
+		hash = HashBytes(hash, &light->range, sizeof(float));
+		hash = HashBytes(hash, &light->color, sizeof(Color));
+	}
+
+	return hash;
+}
+
+// Diffuse and attenuation of light_f.glsl evaluated at every vertex, written to mesh colors,
+// safe to run from worker threads
+void BakeVertexLights(LightHandler *handler, const int32_t *lights, int count, Mesh *mesh) {
+	Vector3 colors[MAX_LIGHTS];
+	for(int n = 0; n < count; n++)
+		colors[n] = ColorQuantized(handler->lights[lights[n]].color);
+
+	for(int v = 0; v < mesh->vertexCount; v++) {
+		Vector3 position = (Vector3) { mesh->vertices[v * 3], mesh->vertices[v * 3 + 1], mesh->vertices[v * 3 + 2] };
+		Vector3 normal = (Vector3) { mesh->normals[v * 3], mesh->normals[v * 3 + 1], mesh->normals[v * 3 + 2] };
+
+		Vector3 total = handler->ambient_color;
+
+		for(int n = 0; n < count; n++) {
+			Light *light = &handler->lights[lights[n]];
+
+			Vector3 to_light = Vector3Subtract(light->position, position);
+			float dist = Vector3Length(to_light);
+
+			float diffuse = (dist > 0) ? fmaxf(Vector3DotProduct(normal, to_light) / dist, 0) : 1;
+
+			// 1 - smoothstep(0, range, dist)
+			float t = Clamp(dist / light->range, 0, 1);
+			float attenuation = 1.0f - t * t * (3.0f - 2.0f * t);
+
+			total = Vector3Add(total, Vector3Scale(colors[n], diffuse * attenuation));
+		}
+
+		unsigned char *out = &mesh->colors[v * 4];
+		out[0] = Clamp(total.x * BAKE_SCALE, 0, 1) * 255.0f + 0.5f;
+		out[1] = Clamp(total.y * BAKE_SCALE, 0, 1) * 255.0f + 0.5f;
+		out[2] = Clamp(total.z * BAKE_SCALE, 0, 1) * 255.0f + 0.5f;
+
+		// Alpha keeps the mesher's AO
+	}
+}
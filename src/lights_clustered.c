@@ -0,0 +1,221 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include "lights.h"
+
+// Light shaders, default then instanced
+#define CLUSTER_SHADERS	3
+
+int cluster_view_loc[CLUSTER_SHADERS];
+int cluster_depth_loc[CLUSTER_SHADERS];
+int cluster_screen_loc[CLUSTER_SHADERS];
+
+// Inclusive cluster box touched by a light
+typedef struct {
+	int16_t min[3];
+	int16_t max[3];
+
+} ClusterRange;
+
+static Texture2D LoadDataTexture(int width, int height, int format, void *pixels) {
+	Image image = (Image) {
+		.data = pixels,
+		.width = width,
+		.height = height,
+		.mipmaps = 1,
+		.format = format
+	};
+
+	Texture2D texture = LoadTextureFromImage(image);
+	SetTextureFilter(texture, TEXTURE_FILTER_POINT);
+
+	return texture;
+}
+
+void InitLightClusters(LightHandler *handler) {
+	LightClusters *clusters = &handler->clusters;
+
+	clusters->grid_px = calloc(CLUSTER_COUNT * 4, sizeof(float));
+	clusters->index_px = calloc(CLUSTER_MAX_INDICES, sizeof(float));
+	clusters->counts = calloc(CLUSTER_COUNT, sizeof(int32_t));
+
+	float *light_px = calloc(MAX_LIGHTS * 2 * 4, sizeof(float));
+
+	clusters->light_data = LoadDataTexture(MAX_LIGHTS, 2, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, light_px);
+	clusters->grid = LoadDataTexture(CLUSTER_X * CLUSTER_Y, CLUSTER_Z, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, clusters->grid_px);
+	clusters->indices = LoadDataTexture(CLUSTER_INDEX_WIDTH, CLUSTER_INDEX_HEIGHT, PIXELFORMAT_UNCOMPRESSED_R32, clusters->index_px);
+
+	free(light_px);
+
+	// Samplers ride on material map slots DrawMesh binds anyway
+	Shader shaders[CLUSTER_SHADERS] = { handler->shader, handler->shader_instanced, handler->shader_water };
+
+	for(int s = 0; s < CLUSTER_SHADERS; s++) {
+		shaders[s].locs[SHADER_LOC_MAP_METALNESS] = GetShaderLocation(shaders[s], "light_data");
+		shaders[s].locs[SHADER_LOC_MAP_NORMAL] = GetShaderLocation(shaders[s], "cluster_grid");
+		shaders[s].locs[SHADER_LOC_MAP_ROUGHNESS] = GetShaderLocation(shaders[s], "light_indices");
+
+		cluster_view_loc[s] = GetShaderLocation(shaders[s], "cluster_view");
+		cluster_depth_loc[s] = GetShaderLocation(shaders[s], "cluster_depth");
+		cluster_screen_loc[s] = GetShaderLocation(shaders[s], "cluster_screen");
+	}
+}
+
+// Point material's extra map slots at cluster textures
+void LightClustersBindMaterial(LightHandler *handler, Material *material) {
+	if(handler->mode != LIGHTING_CLUSTERED) return;
+
+	material->maps[MATERIAL_MAP_METALNESS].texture = handler->clusters.light_data;
+	material->maps[MATERIAL_MAP_NORMAL].texture = handler->clusters.grid;
+	material->maps[MATERIAL_MAP_ROUGHNESS].texture = handler->clusters.indices;
+}
+
+// Upload position, range and color of every light, called when lights are dirty
+void LightClustersUploadLights(LightHandler *handler) {
+	static float light_px[MAX_LIGHTS * 2 * 4];
+
+	for(int i = 0; i < handler->light_count; i++) {
+		Light *light = &handler->lights[i];
+		Vector3 color = ColorQuantized(light->color);
+
+		float *pos = &light_px[i * 4];
+		float *col = &light_px[(MAX_LIGHTS + i) * 4];
+
+		pos[0] = light->position.x, pos[1] = light->position.y, pos[2] = light->position.z, pos[3] = light->range;
+		col[0] = color.x, col[1] = color.y, col[2] = color.z, col[3] = 1;
+	}
+
+	UpdateTexture(handler->clusters.light_data, light_px);
+}
+
+// Find clusters overlapping a light's bounding sphere, false when it touches none
+static bool LightClusterRange(Vector3 center, float radius, float tan_half, float aspect, float log_scale, LightClusters *clusters, ClusterRange *range) {
+	// View space looks down -z
+	float depth = -center.z;
+	if(depth + radius < clusters->near || depth - radius > clusters->far) return false;
+
+	float d_min = fmaxf(depth - radius, clusters->near);
+	float d_max = fminf(depth + radius, clusters->far);
+
+	// Exponential slices, slice = log(d / near) * CLUSTER_Z / log(far / near)
+	range->min[2] = Clamp(floorf(logf(d_min / clusters->near) * log_scale), 0, CLUSTER_Z - 1);
+	range->max[2] = Clamp(floorf(logf(d_max / clusters->near) * log_scale), 0, CLUSTER_Z - 1);
+
+	// Project corners of sphere's view space box, extremes sit at the nearest depth
+	float lo[2] = { 1, 1 }, hi[2] = { -1, -1 };
+	float depths[2] = { d_min, fmaxf(depth + radius, clusters->near) };
+
+	for(int i = 0; i < 8; i++) {
+		float x = center.x + ((i & 1) ? radius : -radius);
+		float y = center.y + ((i & 2) ? radius : -radius);
+		float d = depths[(i >> 2) & 1];
+
+		float ndc[2] = { x / (d * tan_half * aspect), y / (d * tan_half) };
+
+		for(int a = 0; a < 2; a++) {
+			lo[a] = fminf(lo[a], ndc[a]);
+			hi[a] = fmaxf(hi[a], ndc[a]);
+		}
+	}
+
+	int16_t tiles[2] = { CLUSTER_X, CLUSTER_Y };
+
+	for(int a = 0; a < 2; a++) {
+		range->min[a] = Clamp(floorf((lo[a] * 0.5f + 0.5f) * tiles[a]), 0, tiles[a] - 1);
+		range->max[a] = Clamp(floorf((hi[a] * 0.5f + 0.5f) * tiles[a]), 0, tiles[a] - 1);
+	}
+
+	return true;
+}
+
+// Bin enabled lights into view space clusters and upload the per-cluster lists
+void UpdateLightClusters(LightHandler *handler, Camera3D camera, float far) {
+	if(handler->mode != LIGHTING_CLUSTERED) return;
+
+	LightClusters *clusters = &handler->clusters;
+	clusters->near = rlGetCullDistanceNear();
+	clusters->far = far;
+
+	float aspect = (float)GetScreenWidth() / (float)GetScreenHeight();
+	float tan_half = tanf(camera.fovy * DEG2RAD * 0.5f);
+	float log_scale = CLUSTER_Z / logf(clusters->far / clusters->near);
+
+	Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+
+	ClusterRange ranges[MAX_LIGHTS];
+	bool touches[MAX_LIGHTS];
+
+	memset(clusters->counts, 0, sizeof(int32_t) * CLUSTER_COUNT);
+
+	// Count lights per cluster
+	for(int i = 0; i < handler->light_count; i++) {
+		Light *light = &handler->lights[i];
+
+		Vector3 center = Vector3Transform(light->position, view);
+		touches[i] = (light->enabled && LightClusterRange(center, light->range * LIGHT_RANGE_SCALE, tan_half, aspect, log_scale, clusters, &ranges[i]));
+
+		if(!touches[i]) continue;
+
+		for(int z = ranges[i].min[2]; z <= ranges[i].max[2]; z++) {
+			for(int y = ranges[i].min[1]; y <= ranges[i].max[1]; y++) {
+				for(int x = ranges[i].min[0]; x <= ranges[i].max[0]; x++)
+					clusters->counts[x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y]++;
+			}
+		}
+	}
+
+	// Offsets into index list, lists past the end of the texture are cut short
+	int32_t total = 0;
+	for(int c = 0; c < CLUSTER_COUNT; c++) {
+		int32_t count = clusters->counts[c];
+		if(total + count > CLUSTER_MAX_INDICES) count = CLUSTER_MAX_INDICES - total;
+
+		clusters->grid_px[c * 4 + 0] = total;
+		clusters->grid_px[c * 4 + 1] = count;
+
+		// Reused as fill cursor
+		clusters->counts[c] = 0;
+
+		total += count;
+	}
+
+	// Fill index lists
+	for(int i = 0; i < handler->light_count; i++) {
+		if(!touches[i]) continue;
+
+		for(int z = ranges[i].min[2]; z <= ranges[i].max[2]; z++) {
+			for(int y = ranges[i].min[1]; y <= ranges[i].max[1]; y++) {
+				for(int x = ranges[i].min[0]; x <= ranges[i].max[0]; x++) {
+					int c = x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y;
+					if(clusters->counts[c] >= clusters->grid_px[c * 4 + 1]) continue;
+
+					clusters->index_px[(int32_t)clusters->grid_px[c * 4] + clusters->counts[c]++] = i;
+				}
+			}
+		}
+	}
+
+	UpdateTexture(clusters->grid, clusters->grid_px);
+
+	// Only rows holding indices
+	int rows = (total + CLUSTER_INDEX_WIDTH - 1) / CLUSTER_INDEX_WIDTH;
+	if(rows) UpdateTextureRec(clusters->indices, (Rectangle) { 0, 0, CLUSTER_INDEX_WIDTH, rows }, clusters->index_px);
+
+	// Fragment depth = dot(forward, position) - dot(forward, eye)
+	Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+	Vector4 view_plane = (Vector4) { forward.x, forward.y, forward.z, -Vector3DotProduct(forward, camera.position) };
+	Vector2 depth_params = (Vector2) { clusters->near, log_scale };
+	Vector2 screen = (Vector2) { GetRenderWidth(), GetRenderHeight() };
+
+	Shader shaders[CLUSTER_SHADERS] = { handler->shader, handler->shader_instanced, handler->shader_water };
+
+	for(int s = 0; s < CLUSTER_SHADERS; s++) {
+		SetShaderValue(shaders[s], cluster_view_loc[s], &view_plane, SHADER_UNIFORM_VEC4);
+		SetShaderValue(shaders[s], cluster_depth_loc[s], &depth_params, SHADER_UNIFORM_VEC2);
+		SetShaderValue(shaders[s], cluster_screen_loc[s], &screen, SHADER_UNIFORM_VEC2);
+	}
+}
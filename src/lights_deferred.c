@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include "external/glad.h"
+#include "lights.h"
+#include "frustum.h"
+#include "shaders.h"
+
+// G-buffer texture units of the ambient pass, volume pass binds the same ones through its material
+#define GBUFFER_UNIT_POSITION	0
+#define GBUFFER_UNIT_NORMAL		1
+#define GBUFFER_UNIT_ALBEDO		2
+
+int deferred_ambient_loc;
+int deferred_ambient_time_loc;
+
+int deferred_position_loc;
+int deferred_color_loc;
+int deferred_range_loc;
+int deferred_index_loc;
+int deferred_time_loc;
+
+void InitGBuffer(LightHandler *handler) {
+	GBuffer *gbuffer = &handler->gbuffer;
+
+	gbuffer->width = GetRenderWidth();
+	gbuffer->height = GetRenderHeight();
+
+	gbuffer->framebuffer = rlLoadFramebuffer();
+	if(!gbuffer->framebuffer) {
+		printf("ERROR: could not create G-buffer framebuffer\n");
+		return;
+	}
+
+	rlEnableFramebuffer(gbuffer->framebuffer);
+
+	// Positions need full floats, half floats lose whole cells on large maps
+	// RGB float formats aren't guaranteed colour-renderable, so both carry an unused alpha
+	gbuffer->position = rlLoadTexture(NULL, gbuffer->width, gbuffer->height, RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+	gbuffer->normal = rlLoadTexture(NULL, gbuffer->width, gbuffer->height, RL_PIXELFORMAT_UNCOMPRESSED_R16G16B16A16, 1);
+	gbuffer->albedo = rlLoadTexture(NULL, gbuffer->width, gbuffer->height, RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, 1);
+
+	rlActiveDrawBuffers(3);
+
+	rlFramebufferAttach(gbuffer->framebuffer, gbuffer->position, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+	rlFramebufferAttach(gbuffer->framebuffer, gbuffer->normal, RL_ATTACHMENT_COLOR_CHANNEL1, RL_ATTACHMENT_TEXTURE2D, 0);
+	rlFramebufferAttach(gbuffer->framebuffer, gbuffer->albedo, RL_ATTACHMENT_COLOR_CHANNEL2, RL_ATTACHMENT_TEXTURE2D, 0);
+
+	// Depth blit needs the default framebuffer's format, rlLoadTextureDepth picks plain depth
+	glGenRenderbuffers(1, &gbuffer->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, gbuffer->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, gbuffer->width, gbuffer->height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, gbuffer->depth);
+
+	if(!rlFramebufferComplete(gbuffer->framebuffer))
+		printf("ERROR: G-buffer framebuffer is not complete\n");
+
+	rlDisableFramebuffer();
+
+	gbuffer->ambient = LoadShaderVariant(
+		"resources/shaders/deferred_quad_v.glsl",
+		"resources/shaders/deferred_ambient_f.glsl",
+		(handler->flags & LIGHTS_NO_DITHER) ? "" : "#define DITHER\n"
+	);
+
+	int units[3] = { GBUFFER_UNIT_POSITION, GBUFFER_UNIT_NORMAL, GBUFFER_UNIT_ALBEDO };
+	SetShaderValue(gbuffer->ambient, GetShaderLocation(gbuffer->ambient, "g_position"), &units[0], SHADER_UNIFORM_SAMPLER2D);
+	SetShaderValue(gbuffer->ambient, GetShaderLocation(gbuffer->ambient, "g_normal"), &units[1], SHADER_UNIFORM_SAMPLER2D);
+	SetShaderValue(gbuffer->ambient, GetShaderLocation(gbuffer->ambient, "g_albedo"), &units[2], SHADER_UNIFORM_SAMPLER2D);
+
+	deferred_ambient_loc = GetShaderLocation(gbuffer->ambient, "ambient");
+	deferred_ambient_time_loc = GetShaderLocation(gbuffer->ambient, "time");
+
+	gbuffer->volume = LoadShaderVariant(
+		"resources/shaders/deferred_light_v.glsl",
+		"resources/shaders/deferred_light_f.glsl",
+		""
+	);
+
+	// DrawMesh binds map i to unit i, units match GBUFFER_UNIT_*
+	gbuffer->volume.locs[SHADER_LOC_MAP_ALBEDO] = GetShaderLocation(gbuffer->volume, "g_position");
+	gbuffer->volume.locs[SHADER_LOC_MAP_METALNESS] = GetShaderLocation(gbuffer->volume, "g_normal");
+	gbuffer->volume.locs[SHADER_LOC_MAP_NORMAL] = GetShaderLocation(gbuffer->volume, "g_albedo");
+
+	deferred_position_loc = GetShaderLocation(gbuffer->volume, "light_position");
+	deferred_color_loc = GetShaderLocation(gbuffer->volume, "light_color");
+	deferred_range_loc = GetShaderLocation(gbuffer->volume, "light_range");
+	deferred_index_loc = GetShaderLocation(gbuffer->volume, "light_index");
+	deferred_time_loc = GetShaderLocation(gbuffer->volume, "time");
+
+	gbuffer->volume_material = LoadMaterialDefault();
+	gbuffer->volume_material.shader = gbuffer->volume;
+
+	Texture2D targets[3] = {
+		{ .id = gbuffer->position, .width = gbuffer->width, .height = gbuffer->height, .mipmaps = 1 },
+		{ .id = gbuffer->normal, .width = gbuffer->width, .height = gbuffer->height, .mipmaps = 1 },
+		{ .id = gbuffer->albedo, .width = gbuffer->width, .height = gbuffer->height, .mipmaps = 1 }
+	};
+
+	gbuffer->volume_material.maps[MATERIAL_MAP_ALBEDO].texture = targets[GBUFFER_UNIT_POSITION];
+	gbuffer->volume_material.maps[MATERIAL_MAP_METALNESS].texture = targets[GBUFFER_UNIT_NORMAL];
+	gbuffer->volume_material.maps[MATERIAL_MAP_NORMAL].texture = targets[GBUFFER_UNIT_ALBEDO];
+
+	gbuffer->sphere = GenMeshSphere(1, 8, 12);
+}
+
+// Redirect following draws into the G-buffer, material shaders write its attachments
+void BeginGBuffer(LightHandler *handler) {
+	rlEnableFramebuffer(handler->gbuffer.framebuffer);
+	rlClearColor(0, 0, 0, 0);
+	rlClearScreenBuffers();
+
+	// Blending would mix positions and normals
+	rlDisableColorBlend();
+}
+
+// Light the G-buffer into the screen: ambient once per pixel, then every visible light's volume
+void EndGBuffer(LightHandler *handler, Camera3D camera) {
+	GBuffer *gbuffer = &handler->gbuffer;
+	float time = GetTime();
+
+	rlDisableFramebuffer();
+
+	// Ambient, overwrites whole screen with blending still off
+	rlEnableShader(gbuffer->ambient.id);
+
+	rlSetUniform(deferred_ambient_loc, &handler->ambient_color, SHADER_UNIFORM_VEC3, 1);
+	rlSetUniform(deferred_ambient_time_loc, &time, SHADER_UNIFORM_FLOAT, 1);
+
+	unsigned int textures[3] = { gbuffer->position, gbuffer->normal, gbuffer->albedo };
+	for(int i = 0; i < 3; i++) {
+		rlActiveTextureSlot(i);
+		rlEnableTexture(textures[i]);
+	}
+
+	rlLoadDrawQuad();
+
+	for(int i = 2; i >= 0; i--) {
+		rlActiveTextureSlot(i);
+		rlDisableTexture();
+	}
+
+	rlDisableShader();
+	rlEnableColorBlend();
+
+	// Light volumes, back faces without depth test so the camera may sit inside one,
+	// fragments outside the light's range are discarded
+	float aspect = (float)GetScreenWidth() / (float)GetScreenHeight();
+	Frustum frustum = FrustumFromCamera(camera, aspect, rlGetCullDistanceNear(), rlGetCullDistanceFar());
+
+	BeginMode3D(camera);
+	BeginBlendMode(BLEND_ADDITIVE);
+	rlDisableDepthTest();
+	rlDisableDepthMask();
+	rlSetCullFace(RL_CULL_FACE_FRONT);
+
+	SetShaderValue(gbuffer->volume, deferred_time_loc, &time, SHADER_UNIFORM_FLOAT);
+
+	for(int i = 0; i < handler->light_count; i++) {
+		Light *light = &handler->lights[i];
+		if(!light->enabled) continue;
+
+		float radius = light->range * LIGHT_RANGE_SCALE * DEFERRED_VOLUME_PADDING;
+		Vector3 extent = (Vector3) { radius, radius, radius };
+
+		if(FrustumTestBox(&frustum, Vector3Subtract(light->position, extent), Vector3Add(light->position, extent)) == FRUSTUM_OUTSIDE) continue;
+
+		Vector3 color = ColorQuantized(light->color);
+
+		SetShaderValue(gbuffer->volume, deferred_position_loc, &light->position, SHADER_UNIFORM_VEC3);
+		SetShaderValue(gbuffer->volume, deferred_color_loc, &color, SHADER_UNIFORM_VEC3);
+		SetShaderValue(gbuffer->volume, deferred_range_loc, &light->range, SHADER_UNIFORM_FLOAT);
+		SetShaderValue(gbuffer->volume, deferred_index_loc, &i, SHADER_UNIFORM_INT);
+
+		Matrix transform = MatrixMultiply(MatrixScale(radius, radius, radius), MatrixTranslate(light->position.x, light->position.y, light->position.z));
+		DrawMesh(gbuffer->sphere, gbuffer->volume_material, transform);
+	}
+
+	rlSetCullFace(RL_CULL_FACE_BACK);
+	rlEnableDepthMask();
+	rlEnableDepthTest();
+	EndBlendMode();
+	EndMode3D();
+
+	// Scene depth for whatever is drawn after lighting
+	rlBindFramebuffer(RL_READ_FRAMEBUFFER, gbuffer->framebuffer);
+	rlBindFramebuffer(RL_DRAW_FRAMEBUFFER, 0);
+	rlBlitFramebuffer(0, 0, gbuffer->width, gbuffer->height, 0, 0, gbuffer->width, gbuffer->height, GL_DEPTH_BUFFER_BIT);
+	rlDisableFramebuffer();
+}
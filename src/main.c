@@ -1,6 +1,8 @@
 #include "raylib.h"
 #include "config.h"
 #include "map.h"
+#include "jobs.h"
+#include "shaders.h"
 
 int main() {
 	Config config = (Config) { 0 };
@@ -12,7 +14,18 @@ int main() {
 	SetTargetFPS(config.refresh_rate);
 	DisableCursor();
 
+	JobsInit(config.worker_threads);
+
 	Map map = (Map) { 0 };
+
+	// Read by InitLights during MapInit
+	map.light_handler.mode = config.light_mode;
+	if(config.dither_off) map.light_handler.flags |= LIGHTS_NO_DITHER;
+
+	// Read by WaterInit during MapInit
+	map.water_effect.mode = config.water_mode;
+	map.water_effect.cache_mb = config.water_cache_mb;
+
 	MapInit(&map);
 
 	SetExitKey(KEY_F4);
@@ -33,6 +46,8 @@ int main() {
 		EndDrawing();
 	}
 
+	JobsClose();
+	UnloadShaderVariants();
 	CloseWindow();
 
 	return 0;
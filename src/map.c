@@ -9,6 +9,8 @@
 #include "water.h"
 #include "sprites.h"
 #include "rlgl.h"
+#include "mesher.h"
+#include "floodlight.h"
 
 // Pitch, yaw, roll for camera
 float cam_p, cam_y, cam_r;
@@ -16,7 +18,6 @@ float cam_p, cam_y, cam_r;
 Coords hover_coords;
 Ray debug_ray;
 
-RenderTexture2D rt[4];
 Spritesheet water_atlas;
 
 void MapInit(Map *map) {
@@ -28,7 +29,7 @@ void MapInit(Map *map) {
 		.projection = CAMERA_PERSPECTIVE
 	};
 
-	GridInit(&map->grid, (Coords) { 16, 4, 16 }, 4);
+	GridInit(&map->grid, (Coords) { 16, 4, 16 }, 4, LAYOUT_LINEAR);
 	Grid *grid = &map->grid;
 
 	GuiInit(&map->gui);
@@ -42,12 +43,8 @@ void MapInit(Map *map) {
 	//MakeLight(0, 700, CoordsToVec3( (Coords) { grid->cols / 2 , grid->rows / 2, grid->tabs }, &map->grid), WHITE, &map->light_handler);
 	//MakeLight(0, 700, CoordsToVec3( (Coords) { 0, grid->rows / 2, grid->tabs / 2 }, &map->grid), WHITE, &map->light_handler);
 
-	for(uint8_t i = 0; i < 4; i++) {
-		rt[i] = LoadRenderTexture(512 * 0.5f, 512 * 0.5f);
-		SetTextureFilter(rt[i].texture, TEXTURE_FILTER_POINT);
-	}
-
 	WaterInit(&map->water_effect);
+	OcclusionInit(&map->occlusion);
 
 	GenerateAssetTable(map, "");
 
@@ -62,10 +59,12 @@ void MapInit(Map *map) {
 
 void MapUpdate(Map *map, float dt) {
 	UpdateLights(&map->light_handler);
-	WaterUpdate(&map->water_effect, dt);
 
-	// Set which tiles to render
-	UpdateDrawList(map, &map->grid);
+	// Reseed flood fill light from moved, added or removed lights
+	GridSyncLightSeeds(&map->grid, &map->light_handler);
+
+	// Water bands run on workers alongside the rest of the update
+	WaterUpdate(&map->water_effect, dt);
 
 	switch(map->edit_mode) {
 		case MODE_NORMAL:
@@ -77,6 +76,20 @@ void MapUpdate(Map *map, float dt) {
 			break;
 	}
 
+	// Set which tiles to render, after edits and camera movement
+	UpdateDrawList(map, &map->grid);
+
+	// Bin lights for the clustered path with this frame's camera
+	UpdateLightClusters(&map->light_handler, map->camera, DRAW_DISTANCE * map->grid.cell_size);
+
+	// Rebuild geometry of chunks touched by edits
+	GridUpdateMeshes(&map->grid);
+
+	// Relight remeshed chunks and chunks reached by changed lights, baked path only
+	GridBakeLights(&map->grid, &map->light_handler);
+
+	WaterFinish(&map->water_effect);
+
 	// Toggle edit mode
 	if(IsKeyPressed(KEY_ESCAPE)) {
 		map->edit_mode = !map->edit_mode;
@@ -96,22 +109,32 @@ void MapUpdate(Map *map, float dt) {
 }
 
 void MapDraw(Map *map) {
-	for(uint8_t i = 0; i < 4; i++) {
-		int8_t x = i % 2;
-		int8_t y = i / 2;
+	WaterRender(&map->water_effect);
 
-		BeginTextureMode(rt[i]);
-		ClearBackground((Color){0});
-		WaterDrawTile(&map->water_effect, x, y);
-		EndTextureMode();
-	}
+	// Cached water swaps its texture every tick
+	Model *water_model = &map->asset_table[ASSET_WATER].model;
+
+	for(int i = 0; i < water_model->materialCount; i++)
+		water_model->materials[i].maps->texture = map->water_effect.output;
+
+	// Deferred path draws cells into the G-buffer and lights them before anything else
+	bool deferred = (map->light_handler.mode == LIGHTING_DEFERRED);
+	if(deferred) BeginGBuffer(&map->light_handler);
 
 	BeginMode3D(map->camera);
 	
 	uint8_t draw_cells_flags = (DCELLS_DRAW_BOXES | DCELLS_OCCLUSION | DCELLS_ONLY_FLOOR);
 	DrawCells(map, &map->grid, draw_cells_flags);
 
-	for(uint8_t i = 0; i < map->light_handler.light_count; i++)
+	if(deferred) {
+		EndMode3D();
+		EndGBuffer(&map->light_handler, map->camera);
+		BeginMode3D(map->camera);
+	}
+
+	DrawCellGuides(map, &map->grid);
+
+	for(int i = 0; i < map->light_handler.light_count; i++)
 		DrawLightGizmos(&map->light_handler, i);
 
 	EndMode3D();
@@ -121,18 +144,13 @@ void MapDraw(Map *map) {
 
 	DrawText(TextFormat("action count: %d", map->action_count), 0, 0, 30, RAYWHITE);
 	DrawText(TextFormat("current action: %d", map->curr_action), 0, 30, 30, RAYWHITE);
+	DrawText(TextFormat("grid memory: %d kb", GridMemoryUsage(&map->grid) / 1024), 0, 60, 30, RAYWHITE);
 
 	if(map->edit_mode == MODE_INSERT) 
 		GuiUpdate(&map->gui);
 
 	//ClearBackground(WHITE);
-	for(uint8_t i = 0; i < 4; i++) {
-		int x = i % 2;
-		int y = i / 2;
-		
-		Texture tex = map->asset_table[i + 2].model.materials[0].maps->texture;
-		DrawTexture(tex, rt->texture.width * x, rt->texture.height * y, WHITE);
-	}
+	DrawTexture(map->water_effect.output, 0, 0, WHITE);
 }
 
 // Update loop for normal mode
@@ -158,7 +176,7 @@ void MapUpdateModeInsert(Map *map, float dt) {
 
 	if(IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
 		Action action_add_block = (Action) {
-			.cells = malloc(sizeof(uint32_t)),
+			.cells = malloc(sizeof(CellId)),
 			.data = malloc(sizeof(unsigned char)),
 			.rotation = calloc(1, sizeof(uint8_t)),
 			.cell_count = 1,
@@ -191,7 +209,7 @@ void MapUpdateModeInsert(Map *map, float dt) {
 
 	if(IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
 		Action action_remove_block = (Action) {
-			.cells = malloc(sizeof(uint32_t)),
+			.cells = malloc(sizeof(CellId)),
 			.data = malloc(sizeof(unsigned char)),
 			.rotation = malloc(sizeof(uint8_t)),
 			.cell_count = 1,
@@ -215,13 +233,13 @@ void MapUpdateModeInsert(Map *map, float dt) {
 	if(IsKeyPressed(KEY_I)) {
 	}
 
-	uint32_t hover_id = CellCoordsToId(hover_coords, &map->grid);
+	CellId hover_id = CellCoordsToId(hover_coords, &map->grid);
 
 	if(IsKeyPressed(KEY_R)) {
-		if(map->grid.data[hover_id]) {
+		if(GridGetData(&map->grid, hover_id)) {
 
 			Action action_rotate_block = (Action) {
-				.cells = malloc(sizeof(uint32_t)),
+				.cells = malloc(sizeof(CellId)),
 				.data = malloc(sizeof(unsigned char)),
 				.rotation = malloc(sizeof(uint8_t)),
 				.cell_count = 1,
@@ -229,8 +247,8 @@ void MapUpdateModeInsert(Map *map, float dt) {
 			};
 
 			action_rotate_block.cells[0] = CellCoordsToId(hover_coords, &map->grid);
-			action_rotate_block.data[0] = map->grid.data[hover_id];
-			action_rotate_block.rotation[0] = (map->grid.rotation[hover_id] + 1);
+			action_rotate_block.data[0] = GridGetData(&map->grid, hover_id);
+			action_rotate_block.rotation[0] = (GridGetRotation(&map->grid, hover_id) + 1);
 
 			if(action_rotate_block.rotation[0] > 3)
 				action_rotate_block.rotation[0] = 0;
@@ -250,7 +268,7 @@ void MapUpdateModeInsert(Map *map, float dt) {
 }
 
 void GenerateAssetTable(Map *map, char *path) {
-	map->asset_table = malloc(sizeof(Asset) * 16);	
+	map->asset_table = malloc(sizeof(Asset) * ASSET_COUNT);	
 
 	Mesh base_mesh = GenMeshCube(map->grid.cell_size, map->grid.cell_size, map->grid.cell_size);
 	Texture2D base_tex = LoadTexture("resources/base_tex.png");
@@ -262,6 +280,7 @@ void GenerateAssetTable(Map *map, char *path) {
 	for(int i = 0; i < map->asset_table[0].model.materialCount; i++) {
 		map->asset_table[0].model.materials[i].maps->texture = base_tex;
 		map->asset_table[0].model.materials[i].shader = map->light_handler.shader;
+		LightClustersBindMaterial(&map->light_handler, &map->asset_table[0].model.materials[i]);
 	}
 
 	map->asset_table[1] = (Asset) {
@@ -271,76 +290,386 @@ void GenerateAssetTable(Map *map, char *path) {
 	for(int i = 0; i < map->asset_table[1].model.materialCount; i++) {
 		map->asset_table[1].model.materials[i].maps->texture = base_tex;
 		map->asset_table[1].model.materials[i].shader = map->light_handler.shader;
+		LightClustersBindMaterial(&map->light_handler, &map->asset_table[1].model.materials[i]);
 	}
 
-	// water { 0, 0 }
-	map->asset_table[2].model = LoadModelFromMesh(GenMeshPlane(4, 4, 1, 1));
-	for(int i = 0; i < map->asset_table[2].model.materialCount; i++) {
-		map->asset_table[2].model.materials[i].maps->texture = rt[0].texture;
-		map->asset_table[2].model.materials[i].shader = map->light_handler.shader;
-	}
-
-	// water { 1, 0 }
-	map->asset_table[3].model = LoadModelFromMesh(GenMeshPlane(4, 4, 1, 1));
-	for(int i = 0; i < map->asset_table[3].model.materialCount; i++) {
-		map->asset_table[3].model.materials[i].maps->texture = rt[1].texture;
-		map->asset_table[3].model.materials[i].shader = map->light_handler.shader;
-	}
-
-	// water { 0, 1 }
-	map->asset_table[4].model = LoadModelFromMesh(GenMeshPlane(4, 4, 1, 1));
-	for(int i = 0; i < map->asset_table[4].model.materialCount; i++) {
-		map->asset_table[4].model.materials[i].maps->texture = rt[2].texture;
-		map->asset_table[4].model.materials[i].shader = map->light_handler.shader;
-	}
+	// Water shader picks the tile's quarter of the water texture, see DrawCells
+	map->asset_table[ASSET_WATER] = (Asset) {
+		.model = LoadModelFromMesh(GenMeshPlane(4, 4, 1, 1)),
+	};
 
-	// water { 1, 1 }
-	map->asset_table[5].model = LoadModelFromMesh(GenMeshPlane(4, 4, 1, 1));
-	for(int i = 0; i < map->asset_table[5].model.materialCount; i++) {
-		map->asset_table[5].model.materials[i].maps->texture = rt[3].texture;
-		map->asset_table[5].model.materials[i].shader = map->light_handler.shader;
+	for(int i = 0; i < map->asset_table[ASSET_WATER].model.materialCount; i++) {
+		map->asset_table[ASSET_WATER].model.materials[i].maps->texture = map->water_effect.output;
+		map->asset_table[ASSET_WATER].model.materials[i].shader = map->light_handler.shader_water;
+		LightClustersBindMaterial(&map->light_handler, &map->asset_table[ASSET_WATER].model.materials[i]);
 	}
 }
 
-void GridInit(Grid *grid, Coords dimensions, float cell_size) {
+void GridInit(Grid *grid, Coords dimensions, float cell_size, uint8_t layout) {
 	// Free existing data
-	if(grid->data) 
-		free(grid->data);
-
-	if(grid->rotation)
-		free(grid->rotation);
-
-	if(grid->draw_list) 
-		free(grid->draw_list);
+	GridClose(grid);
 
 	// Create new grid
 	Grid new_grid = (Grid) {
 		.draw_list = NULL,
-		.data = NULL,
+		.chunks = NULL,
 
 		.cell_size = cell_size,
 
-		.cell_count = (dimensions.c * dimensions.r * dimensions.t),
+		.cell_count = ((int64_t)dimensions.c * dimensions.r * dimensions.t),
 
 		.cols = dimensions.c,	
 		.rows = dimensions.r,	
 		.tabs = dimensions.t,	
+
+		// Round chunk counts up so partial chunks cover the grid edges
+		.chunk_cols = (dimensions.c + CHUNK_MASK) >> CHUNK_SHIFT,
+		.chunk_rows = (dimensions.r + CHUNK_MASK) >> CHUNK_SHIFT,
+		.chunk_tabs = (dimensions.t + CHUNK_MASK) >> CHUNK_SHIFT,
+
+		.layout = layout
 	};
 
-	// Allocate memory
-	new_grid.draw_list = calloc(new_grid.cell_count, sizeof(int32_t));
-	new_grid.data = calloc(new_grid.cell_count, sizeof(unsigned char));
-	new_grid.rotation = calloc(new_grid.cell_count, sizeof(uint8_t));
+	new_grid.chunk_count = (new_grid.chunk_cols * new_grid.chunk_rows * new_grid.chunk_tabs);
+
+	// Allocate chunk table only, chunks themselves are allocated on first write
+	new_grid.chunks = malloc(sizeof(Chunk*) * new_grid.chunk_count);
+	for(int32_t i = 0; i < new_grid.chunk_count; i++)
+		new_grid.chunks[i] = &chunk_empty;
+
+	new_grid.meshes = calloc(new_grid.chunk_count, sizeof(ChunkMesh));
+	new_grid.light_levels = calloc(new_grid.chunk_count, sizeof(uint8_t*));
+	new_grid.visible_chunks = malloc(sizeof(int32_t) * new_grid.chunk_count);
+
+	new_grid.dirty_cap = 16;
+	new_grid.dirty_chunks = malloc(sizeof(int32_t) * new_grid.dirty_cap);
+
+	// Occupancy bitmap, rows padded to whole words
+	new_grid.occupancy_stride = (dimensions.c + 63) >> 6;
+	new_grid.occupancy = calloc((int64_t)new_grid.occupancy_stride * dimensions.r * dimensions.t, sizeof(uint64_t));
+
+	// Draw list grows on demand in UpdateDrawList
+	new_grid.draw_cap = 64;
+	new_grid.draw_list = malloc(sizeof(CellId) * new_grid.draw_cap);
 
 	// Overwrite grid with new values
 	*grid = new_grid;
 }
 
-int16_t CellCoordsToId(Coords coords, Grid *grid) {
-	return (coords.c + coords.r * grid->cols + coords.t * grid->cols * grid->rows);
+void GridClose(Grid *grid) {
+	if(grid->chunks) {
+		for(int32_t i = 0; i < grid->chunk_count; i++)
+			ChunkFree(grid->chunks[i]);
+
+		free(grid->chunks);
+	}
+
+	if(grid->meshes) {
+		for(int32_t i = 0; i < grid->chunk_count; i++)
+			ChunkMeshFree(&grid->meshes[i]);
+
+		free(grid->meshes);
+	}
+
+	if(grid->light_levels) {
+		for(int32_t i = 0; i < grid->chunk_count; i++)
+			free(grid->light_levels[i]);
+
+		free(grid->light_levels);
+	}
+
+	free(grid->light_add.nodes);
+	free(grid->light_remove.nodes);
+
+	if(grid->draw_list) 
+		free(grid->draw_list);
+
+	if(grid->occupancy)
+		free(grid->occupancy);
+
+	if(grid->dirty_chunks)
+		free(grid->dirty_chunks);
+
+	if(grid->visible_chunks)
+		free(grid->visible_chunks);
+
+	grid->chunks = NULL;
+	grid->meshes = NULL;
+	grid->light_levels = NULL;
+	grid->light_add = (LightQueue) { 0 };
+	grid->light_remove = (LightQueue) { 0 };
+	grid->occupancy = NULL;
+	grid->dirty_chunks = NULL;
+	grid->visible_chunks = NULL;
+	grid->draw_list = NULL;
+	grid->dirty_count = 0;
+	grid->visible_count = 0;
+	grid->chunk_count = 0;
+	grid->draw_count = 0;
+	grid->draw_cap = 0;
+}
+
+// Index of chunk containing cell
+int32_t ChunkIndex(Coords coords, Grid *grid) {
+	int32_t cc = coords.c >> CHUNK_SHIFT;
+	int32_t cr = coords.r >> CHUNK_SHIFT;
+	int32_t ct = coords.t >> CHUNK_SHIFT;
+
+	return (cc + cr * grid->chunk_cols + ct * grid->chunk_cols * grid->chunk_rows);
+}
+
+// Index of cell inside of its chunk, follows the grid's layout
+uint16_t ChunkLocalId(Coords coords, Grid *grid) {
+	uint16_t c = coords.c & CHUNK_MASK;
+	uint16_t r = coords.r & CHUNK_MASK;
+	uint16_t t = coords.t & CHUNK_MASK;
+
+	if(grid->layout == LAYOUT_MORTON) 
+		return MortonEncode3(c, r, t);
+
+	return (c | r << CHUNK_SHIFT | t << (CHUNK_SHIFT * 2));
+}
+
+// Coordinates of cell relative to its chunk's origin
+Coords ChunkLocalCoords(uint16_t local_id, Grid *grid) {
+	if(grid->layout == LAYOUT_MORTON) {
+		uint16_t c, r, t;
+		MortonDecode3(local_id, &c, &r, &t);
+		return (Coords) { c, r, t };
+	}
+
+	return (Coords) {
+		.c = local_id & CHUNK_MASK,
+		.r = (local_id >> CHUNK_SHIFT) & CHUNK_MASK,
+		.t = local_id >> (CHUNK_SHIFT * 2)
+	};
+}
+
+// Coordinates of chunk's first cell
+Coords ChunkOrigin(int32_t chunk_id, Grid *grid) {
+	return (Coords) {
+		.c = (chunk_id % grid->chunk_cols) << CHUNK_SHIFT,
+		.r = ((chunk_id / grid->chunk_cols) % grid->chunk_rows) << CHUNK_SHIFT,
+		.t = (chunk_id / (grid->chunk_cols * grid->chunk_rows)) << CHUNK_SHIFT
+	};
+}
+
+// Index of occupancy word holding cell
+static int64_t OccupancyWord(Coords coords, Grid *grid) {
+	return (coords.r + (int64_t)coords.t * grid->rows) * grid->occupancy_stride + (coords.c >> 6);
+}
+
+// Queue chunk for remeshing before next draw
+void GridMarkChunkDirty(Grid *grid, int32_t chunk_id) {
+	ChunkMesh *chunk_mesh = &grid->meshes[chunk_id];
+	if(chunk_mesh->flags & CHUNK_MESH_DIRTY) return;
+
+	chunk_mesh->flags |= CHUNK_MESH_DIRTY;
+
+	if(grid->dirty_count >= grid->dirty_cap) {
+		grid->dirty_cap *= 2;
+		grid->dirty_chunks = realloc(grid->dirty_chunks, sizeof(int32_t) * grid->dirty_cap);
+	}
+
+	grid->dirty_chunks[grid->dirty_count++] = chunk_id;
+}
+
+// Queue chunk holding cell, plus chunks sharing a face, edge or corner with it when
+// the cell sits on the chunk boundary, their meshes cull against it and read it for AO
+void GridMarkCellDirty(Grid *grid, CellId id) {
+	Coords coords = CellIdToCoords(id, grid);
+	GridMarkChunkDirty(grid, ChunkIndex(coords, grid));
+
+	int16_t local[3] = { coords.c & CHUNK_MASK, coords.r & CHUNK_MASK, coords.t & CHUNK_MASK };
+	int16_t limit[3] = { grid->cols, grid->rows, grid->tabs };
+
+	// Per axis, the side whose neighbour chunk the cell touches, 0 for none
+	int8_t sides[3];
+	for(int d = 0; d < 3; d++)
+		sides[d] = (local[d] == 0) ? -1 : (local[d] == CHUNK_MASK) ? 1 : 0;
+
+	for(int8_t z = -1; z <= 1; z++) {
+		for(int8_t y = -1; y <= 1; y++) {
+			for(int8_t x = -1; x <= 1; x++) {
+				int8_t offset[3] = { x, y, z };
+
+				int16_t n[3] = { coords.c, coords.r, coords.t };
+				bool touches = (x || y || z);
+
+				for(int d = 0; d < 3 && touches; d++) {
+					if(!offset[d]) continue;
+
+					n[d] += offset[d];
+					touches = (offset[d] == sides[d] && n[d] >= 0 && n[d] < limit[d]);
+				}
+
+				if(touches) GridMarkChunkDirty(grid, ChunkIndex((Coords) { n[0], n[1], n[2] }, grid));
+			}
+		}
+	}
+}
+
+unsigned char GridGetData(Grid *grid, CellId id) {
+	Coords coords = CellIdToCoords(id, grid);
+	return ChunkGetData(grid->chunks[ChunkIndex(coords, grid)], ChunkLocalId(coords, grid));
+}
+
+uint8_t GridGetRotation(Grid *grid, CellId id) {
+	Coords coords = CellIdToCoords(id, grid);
+	return ChunkGetRotation(grid->chunks[ChunkIndex(coords, grid)], ChunkLocalId(coords, grid));
+}
+
+void GridSetCell(Grid *grid, CellId id, unsigned char data, uint8_t rotation) {
+	Coords coords = CellIdToCoords(id, grid);
+	int32_t chunk_id = ChunkIndex(coords, grid);
+
+	Chunk *chunk = grid->chunks[chunk_id];
+
+	if(chunk == &chunk_empty) {
+		// Writing air to an empty chunk changes nothing
+		if(!data) return;
+
+		chunk = ChunkCreate();
+		grid->chunks[chunk_id] = chunk;
+	}
+
+	uint16_t local_id = ChunkLocalId(coords, grid);
+	ChunkSetCell(chunk, local_id, data, rotation);
+
+	// Mirror solid state into occupancy bitmap
+	uint64_t *word = &grid->occupancy[OccupancyWord(coords, grid)];
+	uint64_t bit = 1ull << (coords.c & 63);
+
+	if(ChunkGetData(chunk, local_id)) 
+		*word |= bit;
+	else 
+		*word &= ~bit;
+
+	// Release chunks that became all air
+	if(!chunk->solid_count) {
+		ChunkFree(chunk);
+		grid->chunks[chunk_id] = &chunk_empty;
+	}
+}
+
+// Get cell data from coordinates, cells outside of grid are treated as air
+unsigned char GridDataAt(Grid *grid, Coords coords) {
+	if(coords.c < 0 || coords.c >= grid->cols) return 0;
+	if(coords.r < 0 || coords.r >= grid->rows) return 0;
+	if(coords.t < 0 || coords.t >= grid->tabs) return 0;
+
+	return ChunkGetData(grid->chunks[ChunkIndex(coords, grid)], ChunkLocalId(coords, grid));
+}
+
+// Resident size of cell storage in bytes
+uint32_t GridMemoryUsage(Grid *grid) {
+	uint32_t total = sizeof(Chunk*) * grid->chunk_count;
+
+	for(int32_t i = 0; i < grid->chunk_count; i++) {
+		total += ChunkMemoryUsage(grid->chunks[i]);
+		if(grid->light_levels[i]) total += CHUNK_CELLS;
+	}
+
+	return total;
+}
+
+// Occupancy bits of a row word, masked to columns in [min_c, max_c)
+static uint64_t OccupancyLoad(SolidIter *it) {
+	int32_t base = it->word << 6;
+	int32_t lo = it->min.c - base;
+	int32_t hi = it->max.c - base;
+
+	uint64_t mask = ~0ull;
+	if(lo > 0) mask &= ~((1ull << lo) - 1);
+	if(hi < 64) mask &= (1ull << hi) - 1;
+
+	int64_t row = (it->r + (int64_t)it->t * it->grid->rows) * it->grid->occupancy_stride;
+	return it->grid->occupancy[row + it->word] & mask;
+}
+
+// Start iterating solid cells in [min, max), box is clipped to grid
+SolidIter GridSolidIterBegin(Grid *grid, Coords min, Coords max) {
+	if(min.c < 0) min.c = 0;
+	if(min.r < 0) min.r = 0;
+	if(min.t < 0) min.t = 0;
+	if(max.c > grid->cols) max.c = grid->cols;
+	if(max.r > grid->rows) max.r = grid->rows;
+	if(max.t > grid->tabs) max.t = grid->tabs;
+
+	SolidIter it = (SolidIter) {
+		.grid = grid,
+		.min = min,
+		.max = max,
+		.word = min.c >> 6,
+		.r = min.r,
+		.t = min.t
+	};
+
+	// Empty box, mark finished
+	if(min.c >= max.c || min.r >= max.r || min.t >= max.t) {
+		it.t = max.t;
+		return it;
+	}
+
+	it.bits = OccupancyLoad(&it);
+	return it;
+}
+
+// Get next solid cell, returns false when box is exhausted
+bool GridSolidIterNext(SolidIter *it, Coords *coords) {
+	while(!it->bits) {
+		if(it->t >= it->max.t) return false;
+
+		// Next word in row, then next row, then next tab
+		if(++it->word > ((it->max.c - 1) >> 6)) {
+			it->word = it->min.c >> 6;
+
+			if(++it->r >= it->max.r) {
+				it->r = it->min.r;
+
+				if(++it->t >= it->max.t) return false;
+			}
+		}
+
+		it->bits = OccupancyLoad(it);
+	}
+
+	*coords = (Coords) {
+		.c = (it->word << 6) + __builtin_ctzll(it->bits),
+		.r = it->r,
+		.t = it->t
+	};
+
+	// Clear lowest set bit
+	it->bits &= it->bits - 1;
+	return true;
+}
+
+// Number of solid cells in grid
+int64_t GridSolidCount(Grid *grid) {
+	int64_t word_count = (int64_t)grid->occupancy_stride * grid->rows * grid->tabs;
+	int64_t count = 0;
+
+	for(int64_t i = 0; i < word_count; i++)
+		count += __builtin_popcountll(grid->occupancy[i]);
+
+	return count;
+}
+
+CellId CellCoordsToId(Coords coords, Grid *grid) {
+	if(grid->layout == LAYOUT_MORTON)
+		return MortonEncode3(coords.c, coords.r, coords.t);
+
+	return (coords.c + coords.r * (CellId)grid->cols + coords.t * (CellId)grid->cols * grid->rows);
 }
 
-Coords CellIdToCoords(int16_t id, Grid *grid) {
+Coords CellIdToCoords(CellId id, Grid *grid) {
+	if(grid->layout == LAYOUT_MORTON) {
+		uint16_t c, r, t;
+		MortonDecode3(id, &c, &r, &t);
+		return (Coords) { c, r, t };
+	}
+
 	return (Coords) {
 		.c = id % grid->cols,					// x,
 		.r = (id / grid->cols) % grid->rows,	// y,
@@ -366,33 +695,158 @@ bool CoordsInBounds(Coords coords, Grid *grid) {
 			 coords.t > -1 && coords.t < grid->tabs -1 );
 }
 
+static void DrawListPush(Grid *grid, Coords coords) {
+	// Grow draw list when full
+	if(grid->draw_count >= grid->draw_cap) {
+		grid->draw_cap *= 2;
+		grid->draw_list = realloc(grid->draw_list, sizeof(CellId) * grid->draw_cap);
+	}
+
+	grid->draw_list[grid->draw_count++] = CellCoordsToId(coords, grid);
+}
+
+// Cull chunks against the view frustum, then cells of chunks that are only partly inside
 void UpdateDrawList(Map *map, Grid *grid) {
 	grid->draw_count = 0;
+	grid->visible_count = 0;
 
-	for(int32_t i = 0; i < grid->cell_count; i++) {
-		Coords coords = CellIdToCoords(i, grid);
+	float aspect = (float)GetScreenWidth() / (float)GetScreenHeight();
+	float half_cell = grid->cell_size * 0.5f;
 
-		Vector3 position = (Vector3) { coords.c, coords.r, coords.t }; 
-		position = Vector3Scale(position, grid->cell_size);
+	Frustum frustum = FrustumFromCamera(map->camera, aspect, rlGetCullDistanceNear(), DRAW_DISTANCE * grid->cell_size);
 
-		Vector3 camera_forward = Vector3Subtract(map->camera.target, map->camera.position);
-		Vector3 camera_to_cell = Vector3Subtract(position, map->camera.position);
-		
-		float dot = Vector3DotProduct(Vector3Normalize(camera_forward), Vector3Normalize(camera_to_cell));
-		if(dot < 0.0f) continue;
+	// Only visit chunks overlapping the frustum's bounds
+	int16_t chunk_min[3], chunk_max[3];
+	float lo[3] = { frustum.min.x, frustum.min.y, frustum.min.z };
+	float hi[3] = { frustum.max.x, frustum.max.y, frustum.max.z };
+	int16_t limit[3] = { grid->chunk_cols, grid->chunk_rows, grid->chunk_tabs };
+
+	for(int d = 0; d < 3; d++) {
+		float chunk_span = grid->cell_size * CHUNK_SIZE;
+
+		chunk_min[d] = Clamp(floorf((lo[d] + half_cell) / chunk_span), 0, limit[d]);
+		chunk_max[d] = Clamp(floorf((hi[d] + half_cell) / chunk_span) + 1, 0, limit[d]);
+	}
+
+	for(int16_t ct = chunk_min[2]; ct < chunk_max[2]; ct++) {
+		for(int16_t cr = chunk_min[1]; cr < chunk_max[1]; cr++) {
+			for(int16_t cc = chunk_min[0]; cc < chunk_max[0]; cc++) {
+				int32_t chunk_id = cc + cr * grid->chunk_cols + ct * grid->chunk_cols * grid->chunk_rows;
+
+				// Skip regions that are all air
+				if(grid->chunks[chunk_id] == &chunk_empty) continue;
+
+				Coords origin = ChunkOrigin(chunk_id, grid);
+				Coords end = (Coords) { origin.c + CHUNK_SIZE, origin.r + CHUNK_SIZE, origin.t + CHUNK_SIZE };
+
+				// Cells are centered on their coordinates
+				Vector3 box_min = Vector3SubtractValue(CoordsToVec3(origin, grid), half_cell);
+				Vector3 box_max = Vector3SubtractValue(CoordsToVec3(end, grid), half_cell);
+
+				uint8_t result = FrustumTestBox(&frustum, box_min, box_max);
+				if(result == FRUSTUM_OUTSIDE) continue;
+
+				grid->visible_chunks[grid->visible_count++] = chunk_id;
+
+				// Walk only solid cells of chunk
+				Coords coords;
+				SolidIter it = GridSolidIterBegin(grid, origin, end);
+
+				while(GridSolidIterNext(&it, &coords)) {
+					// Chunk fully inside, no need to test its cells
+					if(result == FRUSTUM_INTERSECT) {
+						Vector3 position = CoordsToVec3(coords, grid);
+
+						Vector3 cell_min = Vector3SubtractValue(position, half_cell);
+						Vector3 cell_max = Vector3AddValue(position, half_cell);
+
+						if(FrustumTestBox(&frustum, cell_min, cell_max) == FRUSTUM_OUTSIDE) continue;
+					}
+
+					DrawListPush(grid, coords);
+				}
+			}
+		}
+	}
+}
 
-		if(Vector3Length(camera_to_cell) > 24 * grid->cell_size) continue;
+// Eye position while sorting visible chunks
+Vector3 chunk_sort_eye;
+Grid *chunk_sort_grid;
 
-		grid->draw_list[grid->draw_count++] = i;
+static float ChunkDistanceSqr(int32_t chunk_id) {
+	BoundingBox bounds = chunk_sort_grid->meshes[chunk_id].bounds;
+	Vector3 center = Vector3Scale(Vector3Add(bounds.min, bounds.max), 0.5f);
+
+	return Vector3DistanceSqr(center, chunk_sort_eye);
+}
+
+static int ChunkCompareDistance(const void *a, const void *b) {
+	float da = ChunkDistanceSqr(*(const int32_t*)a);
+	float db = ChunkDistanceSqr(*(const int32_t*)b);
+
+	return (da > db) - (da < db);
+}
+
+// Rasterize occluders of the nearest chunks into a software depth buffer,
+// then drop chunks hidden behind them from the visible chunks and draw list
+static void CullOccludedChunks(Map *map, Grid *grid) {
+	OcclusionBuffer *occ = &map->occlusion;
+	float aspect = (float)GetScreenWidth() / (float)GetScreenHeight();
+
+	OcclusionBegin(occ, map->camera, aspect, rlGetCullDistanceNear(), DRAW_DISTANCE * grid->cell_size);
+
+	// Front to back, nearest chunks hide the most
+	chunk_sort_eye = map->camera.position;
+	chunk_sort_grid = grid;
+	qsort(grid->visible_chunks, grid->visible_count, sizeof(int32_t), ChunkCompareDistance);
+
+	for(int32_t i = 0; i < grid->visible_count && i < OCC_OCCLUDER_CHUNKS; i++) {
+		ChunkMesh *chunk_mesh = &grid->meshes[grid->visible_chunks[i]];
+
+		for(uint8_t j = 0; j < chunk_mesh->occluder_count; j++)
+			OcclusionAddBox(occ, chunk_mesh->occluders[j].min, chunk_mesh->occluders[j].max);
 	}
+
+	OcclusionRasterize(occ);
+
+	int32_t visible_count = 0;
+	for(int32_t i = 0; i < grid->visible_count; i++) {
+		int32_t chunk_id = grid->visible_chunks[i];
+		ChunkMesh *chunk_mesh = &grid->meshes[chunk_id];
+
+		if(!OcclusionTestBox(occ, chunk_mesh->bounds.min, chunk_mesh->bounds.max)) {
+			chunk_mesh->flags |= CHUNK_MESH_OCCLUDED;
+			continue;
+		}
+
+		chunk_mesh->flags &= ~CHUNK_MESH_OCCLUDED;
+		grid->visible_chunks[visible_count++] = chunk_id;
+	}
+
+	grid->visible_count = visible_count;
+
+	int32_t draw_count = 0;
+	for(int32_t i = 0; i < grid->draw_count; i++) {
+		Coords coords = CellIdToCoords(grid->draw_list[i], grid);
+		if(grid->meshes[ChunkIndex(coords, grid)].flags & CHUNK_MESH_OCCLUDED) continue;
+
+		grid->draw_list[draw_count++] = grid->draw_list[i];
+	}
+
+	grid->draw_count = draw_count;
 }
 
 void DrawCells(Map *map, Grid *grid, uint8_t flags) {
-	Vector3 cell_size_v = Vector3Scale(Vector3One(), grid->cell_size);
+	if(flags & DCELLS_OCCLUSION)
+		CullOccludedChunks(map, grid);
+
+	// Cube blocks are drawn as merged chunk geometry
+	QueueChunkMeshes(grid, map->asset_table[0].model.materials[0], &map->light_handler, &map->render_queue);
 
 	for(int32_t i = 0; i < grid->draw_count; i++) {
 		// Get id of cell to draw
-		int32_t cell_id = grid->draw_list[i];
+		CellId cell_id = grid->draw_list[i];
 
 		// Get cell's coordinates
 		Coords coords = CellIdToCoords(grid->draw_list[i], grid);
@@ -408,7 +862,7 @@ void DrawCells(Map *map, Grid *grid, uint8_t flags) {
 
 		if(flags & DCELLS_DRAW_BOXES) {
 			/*
-			if(flags & DCELLS_ONLY_FLOOR && grid->data[cell_id] == 0) {
+			if(flags & DCELLS_ONLY_FLOOR && GridGetData(grid, cell_id) == 0) {
 
 				if(coords.r != 0) continue;
 					
@@ -421,39 +875,54 @@ void DrawCells(Map *map, Grid *grid, uint8_t flags) {
 			*/
 		}
 
-		if(!grid->data[cell_id])
+		unsigned char cell_data = GridGetData(grid, cell_id);
+		if(!cell_data || BlockIsCube(cell_data))
 			continue;
 
 		uint8_t model_id = 0;
-		float angle = 0;
+		uint8_t rotation = GridGetRotation(grid, cell_id) & 3;
 		bool water_cube = false;
+		uint8_t water_tile = 0;
 
 		// Set model
-		switch(grid->data[cell_id]) {
+		switch(cell_data) {
 			case 'x': model_id = 0;	break;
 			case 'c': model_id = 1;	break;
 
-			case 'w': model_id = 2; water_cube = true; break;
-			case 'e': model_id = 3; water_cube = true; break;
-			case 'r': model_id = 4; water_cube = true; break;
-			case 't': model_id = 5; water_cube = true; break;
+			case 'w': model_id = ASSET_WATER; water_tile = 0; water_cube = true; break;
+			case 'e': model_id = ASSET_WATER; water_tile = 1; water_cube = true; break;
+			case 'r': model_id = ASSET_WATER; water_tile = 2; water_cube = true; break;
+			case 't': model_id = ASSET_WATER; water_tile = 3; water_cube = true; break;
 		}
 
-		// Set rotation
-		switch(grid->rotation[cell_id]) {
-			case 0: 	angle = 0;		break;
-			case 1:		angle = 90;		break;
-			case 2:		angle = 180;	break;
-			case 3: 	angle = 270;	break;
+		if(water_cube) {
+			//DrawCubeV(Vector3Subtract(position, (Vector3) {0, 0.1f, 0} ), (Vector3) { 4, 4 - 0.1f, 4 }, ColorAlpha(SKYBLUE, 0.1f));
+			position = Vector3Subtract(position, Vector3Scale(CAMERA_UP, 1.9f));
 		}
 
+		// Queue for instanced drawing, exact rotation keeps it usable as normal matrix
+		Matrix transform = MatrixMultiply(MatrixRotateY90(rotation), MatrixTranslate(position.x, position.y, position.z));
+
+		// Tile rides in the matrix's unused bottom row, every water cell goes into one draw
 		if(water_cube) {
-			//DrawCubeV(Vector3Subtract(position, (Vector3) {0, 0.1f, 0} ), (Vector3) { 4, 4 - 0.1f, 4 }, ColorAlpha(SKYBLUE, 0.1f));
-			DrawModelShadedEx(map->asset_table[model_id].model, Vector3Subtract(position, Vector3Scale(CAMERA_UP, 1.9f)), CAMERA_UP, angle);
-		} else 
-			DrawModelShadedEx(map->asset_table[model_id].model, position, CAMERA_UP, angle);
+			transform.m3 = water_tile % 2;
+			transform.m7 = water_tile / 2;
+			rotation = 0;
+		}
+
+		InstanceBatchPush(&map->instance_batches[model_id][rotation], transform);
 	}	
 
+	QueueInstanceBatches(map);
+
+	// Submit grouped by shader, texture and mesh
+	RenderQueueFlush(&map->render_queue);
+}
+
+// Editor wireframes, drawn after lighting since the G-buffer can't take them
+void DrawCellGuides(Map *map, Grid *grid) {
+	Vector3 cell_size_v = Vector3Scale(Vector3One(), grid->cell_size);
+
 	if(map->edit_mode == MODE_INSERT) {
 		DrawCubeWiresV(CoordsToVec3(hover_coords, grid), cell_size_v, BLUE);
 	}
@@ -465,6 +934,37 @@ void DrawCells(Map *map, Grid *grid, uint8_t flags) {
 	);
 }
 
+void InstanceBatchPush(InstanceBatch *batch, Matrix transform) {
+	if(batch->count >= batch->cap) {
+		batch->cap = (batch->cap) ? batch->cap * 2 : 16;
+		batch->transforms = realloc(batch->transforms, sizeof(Matrix) * batch->cap);
+	}
+
+	batch->transforms[batch->count++] = transform;
+}
+
+// Queue one instanced draw per mesh of each asset and rotation group, then reset batches,
+// transforms stay valid until the queue is flushed
+void QueueInstanceBatches(Map *map) {
+	for(uint8_t model_id = 0; model_id < ASSET_COUNT; model_id++) {
+		for(uint8_t rotation = 0; rotation < 4; rotation++) {
+			InstanceBatch *batch = &map->instance_batches[model_id][rotation];
+			if(!batch->count) continue;
+
+			Model model = map->asset_table[model_id].model;
+
+			for(int m = 0; m < model.meshCount; m++) {
+				Material material = model.materials[model.meshMaterial[m]];
+				if(model_id != ASSET_WATER) material.shader = map->light_handler.shader_instanced;
+
+				RenderQueuePushInstanced(&map->render_queue, &model.meshes[m], material, batch->transforms, batch->count, rotation);
+			}
+
+			batch->count = 0;
+		}
+	}
+}
+
 // Use keyboard and mouse input to move camera
 void CameraControls(Map *map, float dt) {
 	Camera *cam = &map->camera;
@@ -518,7 +1018,7 @@ void ActionApply(Action *action, Map *map) {
 	}
 
 	Action undo_action = (Action) {
-		.cells = malloc(sizeof(uint32_t) * action->cell_count), 
+		.cells = malloc(sizeof(CellId) * action->cell_count), 
 		.data = malloc(sizeof(unsigned char) * action->cell_count),
 		.rotation = calloc(action->cell_count, sizeof(uint8_t)),
 		.cell_count = action->cell_count,
@@ -526,16 +1026,19 @@ void ActionApply(Action *action, Map *map) {
 	};
 
 	for(uint32_t i = 0; i < action->cell_count; i++) {
-		uint32_t cell_id = action->cells[i];	
+		CellId cell_id = action->cells[i];	
 
 		undo_action.cells[i] = cell_id;
-		undo_action.data[i] = map->grid.data[cell_id]; 
-		undo_action.rotation[i] = map->grid.rotation[cell_id];
+		undo_action.data[i] = GridGetData(&map->grid, cell_id); 
+		undo_action.rotation[i] = GridGetRotation(&map->grid, cell_id);
 
-		map->grid.data[cell_id] = action->data[i];
-		map->grid.rotation[cell_id] = action->rotation[i];
+		GridSetCell(&map->grid, cell_id, action->data[i], action->rotation[i]);
+		GridMarkCellDirty(&map->grid, cell_id);
+		GridLightMarkCell(&map->grid, CellIdToCoords(cell_id, &map->grid));
 	}
 
+	GridLightPropagate(&map->grid);
+
 	map->actions_redo[map->action_count] = *action; 
 	map->actions_undo[map->action_count] = undo_action; 
 
@@ -553,11 +1056,14 @@ void ActionUndo(Map *map) {
 
 	// Set data
 	for(uint32_t i = 0; i < action_undo->cell_count; i++) {
-		uint32_t cell_id = action_undo->cells[i];
+		CellId cell_id = action_undo->cells[i];
 
-		map->grid.data[cell_id] = action_undo->data[i];
-		map->grid.rotation[cell_id] = action_undo->rotation[i];
+		GridSetCell(&map->grid, cell_id, action_undo->data[i], action_undo->rotation[i]);
+		GridMarkCellDirty(&map->grid, cell_id);
+		GridLightMarkCell(&map->grid, CellIdToCoords(cell_id, &map->grid));
 	}
+
+	GridLightPropagate(&map->grid);
 }
 
 void ActionRedo(Map *map) {
@@ -568,12 +1074,15 @@ void ActionRedo(Map *map) {
 
 	// Set data
 	for(uint32_t i = 0; i < action_redo->cell_count; i++) {
-		uint32_t cell_id = action_redo->cells[i];
+		CellId cell_id = action_redo->cells[i];
 
-		map->grid.data[cell_id] = action_redo->data[i];
-		map->grid.rotation[cell_id] = action_redo->rotation[i];
+		GridSetCell(&map->grid, cell_id, action_redo->data[i], action_redo->rotation[i]);
+		GridMarkCellDirty(&map->grid, cell_id);
+		GridLightMarkCell(&map->grid, CellIdToCoords(cell_id, &map->grid));
 	}
 
+	GridLightPropagate(&map->grid);
+
 	map->curr_action++;
 }
 
@@ -602,8 +1111,13 @@ void MapExportLayout(Map *map, char *path) {
 	fprintf(pF, "%d\n", map->grid.rows);	
 	fprintf(pF, "%d\n", map->grid.tabs);	
 
-	for(uint32_t i = 0; i < map->grid.cell_count; i++) 
-		fputc(map->grid.data[i], pF);
+	// Layout file is always written in linear order, independent of grid layout
+	for(int16_t t = 0; t < map->grid.tabs; t++) {
+		for(int16_t r = 0; r < map->grid.rows; r++) {
+			for(int16_t c = 0; c < map->grid.cols; c++) 
+				fputc(GridDataAt(&map->grid, (Coords) { c, r, t }), pF);
+		}
+	}
 
 	fclose(pF);	
 }
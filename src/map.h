@@ -3,6 +3,11 @@
 #include "raylib.h"
 #include "gui.h"
 #include "water.h"
+#include "chunk.h"
+#include "gridmath.h"
+#include "frustum.h"
+#include "occlusion.h"
+#include "render.h"
 
 #ifndef MAP_H_
 #define MAP_H_
@@ -14,31 +19,143 @@ typedef struct {
 
 } Coords;
 
+// Cell id, wide enough for Morton ids of any grid Coords can address
+typedef int64_t CellId;
+
+enum GRID_LAYOUTS : uint8_t {
+	LAYOUT_LINEAR,	// c + r * cols + t * cols * rows
+	LAYOUT_MORTON	// Z-order, interleaved coordinate bits
+};
+
+#define CHUNK_MESH_DIRTY	0x01
+#define CHUNK_MESH_OCCLUDED	0x02
+#define CHUNK_MESH_UNBAKED	0x04	// New geometry, vertex colors not baked yet
+#define CHUNK_MESH_REBAKED	0x08	// Vertex colors changed, waiting for upload
+
+// Flood fill light, level drops by one per cell travelled
+#define LIGHT_LEVEL_MAX		15
+
 typedef struct {
-	int32_t *draw_list;
+	Coords coords;
+	uint8_t level;
 
-	unsigned char *data;
-	uint8_t *rotation;
+} LightNode;
+
+// FIFO of flood fill nodes, rewound whenever drained
+typedef struct {
+	LightNode *nodes;
+
+	int32_t head;
+	int32_t count;
+	int32_t cap;
+
+} LightQueue;
+
+// Boxes of opaque cells kept per chunk for occlusion culling
+#define CHUNK_OCCLUDERS		4
+
+// Merged geometry of a chunk's cube blocks, uploaded as one mesh
+typedef struct {
+	Mesh mesh;
+
+	// Bounds of chunk's solid cells
+	BoundingBox bounds;
+
+	// Largest boxes completely filled with opaque cells
+	BoundingBox occluders[CHUNK_OCCLUDERS];
+	uint8_t occluder_count;
+
+	// Forward lights reaching bounds, valid while light_version matches the handler's
+	int32_t lights[MAX_FORWARD_LIGHTS];
+	uint8_t light_count;
+	uint32_t light_version;
+
+	// Hash of lights the vertex colors were baked with, baked path only
+	uint32_t bake_hash;
+
+	uint8_t flags;
+
+} ChunkMesh;
+
+typedef struct {
+	CellId *draw_list;
+
+	// Chunks overlapping the view frustum, filled by UpdateDrawList
+	int32_t *visible_chunks;
+	int32_t visible_count;
+
+	// Chunk table, unallocated entries point at chunk_empty
+	Chunk **chunks;
+
+	// Chunk geometry, parallel to chunk table
+	ChunkMesh *meshes;
+
+	// Chunks waiting to be remeshed
+	int32_t *dirty_chunks;
+	int32_t dirty_count;
+	int32_t dirty_cap;
+
+	// Light handler version chunks were last checked for rebakes against
+	uint32_t bake_version;
+
+	// Flood fill light level per cell, indexed like chunk cells, NULL while a chunk is dark
+	uint8_t **light_levels;
+
+	LightQueue light_add;
+	LightQueue light_remove;
+
+	// Cells seeded by Light entries, synced when the light handler version changes
+	LightNode light_seeds[MAX_LIGHTS];
+	int32_t light_seed_count;
+	uint32_t light_seed_version;
+
+	// 1 bit per cell, set when solid, 64 cells of a row per word
+	uint64_t *occupancy;
+	int32_t occupancy_stride;	// Words per row
 
 	float cell_size;
 
-	int32_t cell_count;
+	int64_t cell_count;
 	int32_t draw_count;
+	int32_t draw_cap;
+
+	int32_t chunk_count;
 
 	int16_t cols;	// width
 	int16_t rows;	// height
 	int16_t tabs;	// depth
+
+	int16_t chunk_cols;
+	int16_t chunk_rows;
+	int16_t chunk_tabs;
+
+	uint8_t layout;
 	
 } Grid;
 
+#define ASSET_COUNT 16
+
+// Water plane of cells 'w', 'e', 'r' and 't', each shows its own quarter of the water texture
+#define ASSET_WATER	2
+
 typedef struct {
 	Model model;
 	Material material;
 
 } Asset;
 
+// Transforms of visible cells sharing an asset and rotation,
+// drawn together with one instanced draw call
 typedef struct {
-	uint32_t *cells;
+	Matrix *transforms;
+
+	int32_t count;
+	int32_t cap;
+
+} InstanceBatch;
+
+typedef struct {
+	CellId *cells;
 	unsigned char *data;
 	uint8_t  *rotation;
 
@@ -71,6 +188,15 @@ typedef struct {
 
 	Asset *asset_table;
 
+	// Per asset and rotation, refilled every frame
+	InstanceBatch instance_batches[ASSET_COUNT][4];
+
+	// Software depth buffer for DCELLS_OCCLUSION
+	OcclusionBuffer occlusion;
+
+	// Draws of DrawCells, submitted sorted by state
+	RenderQueue render_queue;
+
 	uint16_t curr_action;
 	uint16_t action_count;
 	uint16_t action_cap;
@@ -92,22 +218,64 @@ void MapUpdateModeInsert(Map *map, float dt);
 
 void GenerateAssetTable(Map *map, char *path);
 
-void GridInit(Grid *grid, Coords dimensions, float cell_size);
+void GridInit(Grid *grid, Coords dimensions, float cell_size, uint8_t layout);
+void GridClose(Grid *grid);
+
+unsigned char GridGetData(Grid *grid, CellId id);
+uint8_t GridGetRotation(Grid *grid, CellId id);
+void GridSetCell(Grid *grid, CellId id, unsigned char data, uint8_t rotation);
+
+unsigned char GridDataAt(Grid *grid, Coords coords);
+uint32_t GridMemoryUsage(Grid *grid);
+
+int32_t ChunkIndex(Coords coords, Grid *grid);
+uint16_t ChunkLocalId(Coords coords, Grid *grid);
+Coords ChunkLocalCoords(uint16_t local_id, Grid *grid);
+Coords ChunkOrigin(int32_t chunk_id, Grid *grid);
+
+void GridMarkChunkDirty(Grid *grid, int32_t chunk_id);
+void GridMarkCellDirty(Grid *grid, CellId id);
+
+CellId CellCoordsToId(Coords coords, Grid *grid);
+Coords CellIdToCoords(CellId id, Grid *grid);
+
+// Iterates solid cells of a box via the occupancy bitmap,
+// skips up to 64 empty cells per step
+typedef struct {
+	Grid *grid;
+
+	uint64_t bits;	// Unvisited solid cells of current word
+
+	Coords min;		// Inclusive
+	Coords max;		// Exclusive
+
+	int32_t word;	// Word index in current row
+	int16_t r, t;
 
-int16_t CellCoordsToId(Coords coords, Grid *grid);
-Coords CellIdToCoords(int16_t id, Grid *grid);
+} SolidIter;
+
+SolidIter GridSolidIterBegin(Grid *grid, Coords min, Coords max);
+bool GridSolidIterNext(SolidIter *it, Coords *coords);
+int64_t GridSolidCount(Grid *grid);
 
 Coords Vec3ToCoords(Vector3 v, Grid *grid);
 Vector3 CoordsToVec3(Coords coords, Grid *grid);
 
 bool CoordsInBounds(Coords coords, Grid *grid);
 
+// Cells beyond this many cells from the camera are not drawn
+#define DRAW_DISTANCE	24
+
 void UpdateDrawList(Map *map, Grid *grid);
 
 #define DCELLS_DRAW_BOXES	0x01
 #define DCELLS_OCCLUSION	0x02
 #define DCELLS_ONLY_FLOOR	0x04
 void DrawCells(Map *map, Grid *grid, uint8_t flags);
+void DrawCellGuides(Map *map, Grid *grid);
+
+void InstanceBatchPush(InstanceBatch *batch, Matrix transform);
+void QueueInstanceBatches(Map *map);
 
 #define CAMERA_UP				 (Vector3) { 0, 1, 0 }
 #define CAMERA_SPEED							50.00f
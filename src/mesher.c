@@ -0,0 +1,560 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include "jobs.h"
+#include "lights.h"
+#include "map.h"
+#include "mesher.h"
+
+// Meshes use 16 bit indices
+#define MESH_MAX_VERTICES	65536
+
+// Chunk volume padded by one cell of neighbours on every side
+#define PADDED_SIZE		(CHUNK_SIZE + 2)
+#define PADDED_CELLS	(PADDED_SIZE * PADDED_SIZE * PADDED_SIZE)
+
+// Index into padded volume, coordinates are chunk local and may be -1 or CHUNK_SIZE
+#define PADDED(x, y, z) (((x) + 1) + ((y) + 1) * PADDED_SIZE + ((z) + 1) * PADDED_SIZE * PADDED_SIZE)
+
+// Per-cell flags of padded volume
+#define CELL_CUBE	0x01
+#define CELL_OPAQUE	0x02
+
+// Smaller boxes hide too little to be worth rasterizing
+#define OCCLUDER_MIN_CELLS	4
+
+// Slice mask entry of a visible face, low byte holds its packed corner AO
+#define FACE_VISIBLE	0x100
+
+// Vertex alpha per AO level, 0 = corner between two walls, 3 = open
+static const unsigned char ao_alpha[4] = { 102, 153, 204, 255 };
+
+// Packed AO of a face's corners (0,0), (1,0), (1,1), (0,1) in slice u, v order,
+// 2 bits each, indexed by the opaque mask of the 8 cells in front of the face
+static uint8_t ao_lut[256];
+static bool ao_lut_ready = false;
+
+// Growable vertex data for one chunk
+typedef struct {
+	float *vertices;
+	float *normals;
+	float *texcoords;
+	unsigned char *colors;
+	unsigned short *indices;
+
+	int quad_count;
+	int quad_cap;
+
+} MeshBuilder;
+
+bool BlockIsCube(unsigned char data) {
+	return (data == 'x');
+}
+
+bool BlockIsOpaque(unsigned char data) {
+	return (data == 'x');
+}
+
+// Neighbour bits: v - 1 row is 0..2, u - 1 and u + 1 are 3 and 4, v + 1 row is 5..7
+static void BuildAOTable() {
+	// Side along u, side along v and diagonal per corner
+	const uint8_t corner_bits[4][3] = { 
+		{ 3, 1, 0 }, 
+		{ 4, 1, 2 }, 
+		{ 4, 6, 7 }, 
+		{ 3, 6, 5 } 
+	};
+
+	for(int mask = 0; mask < 256; mask++) {
+		uint8_t packed = 0;
+
+		for(int q = 0; q < 4; q++) {
+			int side_u = (mask >> corner_bits[q][0]) & 1;
+			int side_v = (mask >> corner_bits[q][1]) & 1;
+			int diagonal = (mask >> corner_bits[q][2]) & 1;
+
+			// Two walls hide the corner even when the diagonal cell is open
+			int ao = (side_u && side_v) ? 0 : 3 - (side_u + side_v + diagonal);
+			packed |= ao << (q * 2);
+		}
+
+		ao_lut[mask] = packed;
+	}
+
+	ao_lut_ready = true;
+}
+
+static uint8_t CellFlags(unsigned char data) {
+	uint8_t flags = 0;
+
+	if(BlockIsCube(data)) flags |= CELL_CUBE;
+	if(BlockIsOpaque(data)) flags |= CELL_OPAQUE;
+
+	return flags;
+}
+
+// Append a quad, corners must be counter-clockwise seen from the normal's side
+static void BuilderAddQuad(MeshBuilder *b, Vector3 corners[4], uint8_t ao[4], Vector3 normal, float w, float h) {
+	if((b->quad_count + 1) * 4 > MESH_MAX_VERTICES) {
+		printf("ERROR: chunk mesh vertex limit reached, quad dropped\n");
+		return;
+	}
+
+	if(b->quad_count >= b->quad_cap) {
+		b->quad_cap = (b->quad_cap) ? b->quad_cap * 2 : 64;
+
+		b->vertices  = realloc(b->vertices,  sizeof(float) * 12 * b->quad_cap);
+		b->normals   = realloc(b->normals,   sizeof(float) * 12 * b->quad_cap);
+		b->texcoords = realloc(b->texcoords, sizeof(float) *  8 * b->quad_cap);
+		b->colors    = realloc(b->colors,    sizeof(unsigned char) * 16 * b->quad_cap);
+		b->indices   = realloc(b->indices,   sizeof(unsigned short) * 6 * b->quad_cap);
+	}
+
+	// Texture repeats once per cell across merged quads
+	float uv[4][2] = { { 0, 0 }, { w, 0 }, { w, h }, { 0, h } };
+
+	int q = b->quad_count;
+	for(int i = 0; i < 4; i++) {
+		b->vertices[q * 12 + i * 3 + 0] = corners[i].x;
+		b->vertices[q * 12 + i * 3 + 1] = corners[i].y;
+		b->vertices[q * 12 + i * 3 + 2] = corners[i].z;
+
+		b->normals[q * 12 + i * 3 + 0] = normal.x;
+		b->normals[q * 12 + i * 3 + 1] = normal.y;
+		b->normals[q * 12 + i * 3 + 2] = normal.z;
+
+		b->texcoords[q * 8 + i * 2 + 0] = uv[i][0];
+		b->texcoords[q * 8 + i * 2 + 1] = uv[i][1];
+
+		// Lit by shaders until baked, alpha carries AO
+		for(int c = 0; c < 3; c++)
+			b->colors[q * 16 + i * 4 + c] = 255;
+
+		b->colors[q * 16 + i * 4 + 3] = ao_alpha[ao[i]];
+	}
+
+	// Split along the brighter diagonal so AO interpolates without a crease
+	unsigned short base = q * 4;
+	unsigned short quad_indices[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+
+	if(ao[0] + ao[2] < ao[1] + ao[3]) {
+		unsigned short flipped[6] = { base + 1, base + 2, base + 3, base + 1, base + 3, base };
+
+		for(int i = 0; i < 6; i++)
+			quad_indices[i] = flipped[i];
+	}
+
+	for(int i = 0; i < 6; i++)
+		b->indices[q * 6 + i] = quad_indices[i];
+
+	b->quad_count++;
+}
+
+// Merge faces of a slice mask with equal AO into as few rectangles as possible,
+// d is the slice axis, side is -1 or 1 for the face direction
+static void GreedySlice(MeshBuilder *b, uint16_t mask[CHUNK_SIZE][CHUNK_SIZE], int d, int side, int k, Coords origin, float cell_size) {
+	int u = (d + 1) % 3;
+	int v = (d + 2) % 3;
+
+	for(int j = 0; j < CHUNK_SIZE; j++) {
+		for(int i = 0; i < CHUNK_SIZE; ) {
+			uint16_t face = mask[j][i];
+			if(!face) {
+				i++;
+				continue;
+			}
+
+			// Widen along u while faces match
+			int w = 1;
+			while(i + w < CHUNK_SIZE && mask[j][i + w] == face) w++;
+
+			// Extend along v while whole row matches
+			int h = 1;
+			for(; j + h < CHUNK_SIZE; h++) {
+				bool row = true;
+
+				for(int n = 0; n < w; n++) {
+					if(mask[j + h][i + n] != face) {
+						row = false;
+						break;
+					}
+				}
+
+				if(!row) break;
+			}
+
+			// Clear merged faces
+			for(int y = 0; y < h; y++) {
+				for(int x = 0; x < w; x++) 
+					mask[j + y][i + x] = 0;
+			}
+
+			// Corner of quad in cell units, relative to grid origin
+			float p[3] = { origin.c, origin.r, origin.t };
+			p[d] += k + ((side > 0) ? 1 : 0);
+			p[u] += i;
+			p[v] += j;
+
+			float du[3] = { 0 }, dv[3] = { 0 }, n[3] = { 0 };
+			du[u] = w * cell_size;
+			dv[v] = h * cell_size;
+			n[d] = side;
+
+			// Cells are centered on their coordinates
+			Vector3 c0 = Vector3SubtractValue(Vector3Scale((Vector3) { p[0], p[1], p[2] }, cell_size), cell_size * 0.5f);
+			Vector3 U = (Vector3) { du[0], du[1], du[2] };
+			Vector3 V = (Vector3) { dv[0], dv[1], dv[2] };
+
+			// Merged faces share AO, quad corners take it from matching face corners
+			uint8_t corner_ao[4];
+			for(int q = 0; q < 4; q++)
+				corner_ao[q] = (face >> (q * 2)) & 3;
+
+			Vector3 corners[4];
+			uint8_t ao[4];
+			if(side > 0) {
+				corners[0] = c0;
+				corners[1] = Vector3Add(c0, U);
+				corners[2] = Vector3Add(Vector3Add(c0, U), V);
+				corners[3] = Vector3Add(c0, V);
+
+				ao[0] = corner_ao[0], ao[1] = corner_ao[1], ao[2] = corner_ao[2], ao[3] = corner_ao[3];
+			} else {
+				corners[0] = c0;
+				corners[1] = Vector3Add(c0, V);
+				corners[2] = Vector3Add(Vector3Add(c0, U), V);
+				corners[3] = Vector3Add(c0, U);
+
+				ao[0] = corner_ao[0], ao[1] = corner_ao[3], ao[2] = corner_ao[2], ao[3] = corner_ao[1];
+			}
+
+			BuilderAddQuad(b, corners, ao, (Vector3) { n[0], n[1], n[2] }, (side > 0) ? w : h, (side > 0) ? h : w);
+
+			i += w;
+		}
+	}
+}
+
+// World space box covering cells [min, max) of a chunk
+static BoundingBox ChunkCellBox(Coords origin, int min[3], int max[3], float cell_size) {
+	Vector3 lo = (Vector3) { origin.c + min[0], origin.r + min[1], origin.t + min[2] };
+	Vector3 hi = (Vector3) { origin.c + max[0], origin.r + max[1], origin.t + max[2] };
+
+	// Cells are centered on their coordinates
+	return (BoundingBox) {
+		Vector3SubtractValue(Vector3Scale(lo, cell_size), cell_size * 0.5f),
+		Vector3SubtractValue(Vector3Scale(hi, cell_size), cell_size * 0.5f)
+	};
+}
+
+// Greedily grow boxes of opaque cells along x, y then z, keep the largest few as occluders
+static void ChunkFindOccluders(ChunkMesh *chunk_mesh, uint8_t cells[PADDED_CELLS], Coords origin, float cell_size) {
+	uint8_t open[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
+	int volumes[CHUNK_OCCLUDERS] = { 0 };
+
+	for(int z = 0; z < CHUNK_SIZE; z++) {
+		for(int y = 0; y < CHUNK_SIZE; y++) {
+			for(int x = 0; x < CHUNK_SIZE; x++)
+				open[z][y][x] = (cells[PADDED(x, y, z)] & CELL_OPAQUE) != 0;
+		}
+	}
+
+	chunk_mesh->occluder_count = 0;
+
+	for(int z = 0; z < CHUNK_SIZE; z++) {
+		for(int y = 0; y < CHUNK_SIZE; y++) {
+			for(int x = 0; x < CHUNK_SIZE; x++) {
+				if(!open[z][y][x]) continue;
+
+				int w = 1, h = 1, l = 1;
+				while(x + w < CHUNK_SIZE && open[z][y][x + w]) w++;
+
+				for(bool grow = true; grow && y + h < CHUNK_SIZE; ) {
+					for(int i = 0; i < w; i++) grow &= open[z][y + h][x + i];
+					if(grow) h++;
+				}
+
+				for(bool grow = true; grow && z + l < CHUNK_SIZE; ) {
+					for(int j = 0; j < h; j++) {
+						for(int i = 0; i < w; i++) grow &= open[z + l][y + j][x + i];
+					}
+					if(grow) l++;
+				}
+
+				for(int k = 0; k < l; k++) {
+					for(int j = 0; j < h; j++) {
+						for(int i = 0; i < w; i++) open[z + k][y + j][x + i] = 0;
+					}
+				}
+
+				int volume = w * h * l;
+				if(volume < OCCLUDER_MIN_CELLS) continue;
+
+				// Replace smallest kept box
+				int slot = 0;
+				for(int i = 1; i < CHUNK_OCCLUDERS; i++) {
+					if(volumes[i] < volumes[slot]) slot = i;
+				}
+
+				if(volume <= volumes[slot]) continue;
+
+				int min[3] = { x, y, z };
+				int max[3] = { x + w, y + h, z + l };
+
+				if(!volumes[slot]) chunk_mesh->occluder_count++;
+				volumes[slot] = volume;
+				chunk_mesh->occluders[slot] = ChunkCellBox(origin, min, max, cell_size);
+			}
+		}
+	}
+}
+
+// Build and upload merged geometry for all cube blocks of a chunk
+void MeshChunk(Grid *grid, int32_t chunk_id) {
+	ChunkMesh *chunk_mesh = &grid->meshes[chunk_id];
+	ChunkMeshFree(chunk_mesh);
+
+	chunk_mesh->occluder_count = 0;
+
+	// Bounds change, reassign lights on next draw
+	chunk_mesh->light_version = 0;
+	chunk_mesh->flags |= CHUNK_MESH_UNBAKED;
+
+	if(grid->chunks[chunk_id] == &chunk_empty) return;
+
+	Coords origin = ChunkOrigin(chunk_id, grid);
+	Coords end = (Coords) { origin.c + CHUNK_SIZE, origin.r + CHUNK_SIZE, origin.t + CHUNK_SIZE };
+
+	// Gather chunk cells into a padded scratch volume
+	uint8_t cells[PADDED_CELLS] = { 0 };
+
+	int lo[3] = { CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE };
+	int hi[3] = { 0, 0, 0 };
+
+	Coords coords;
+	SolidIter it = GridSolidIterBegin(grid, origin, end);
+	while(GridSolidIterNext(&it, &coords)) {
+		int local[3] = { coords.c - origin.c, coords.r - origin.r, coords.t - origin.t };
+		cells[PADDED(local[0], local[1], local[2])] = CellFlags(GridDataAt(grid, coords));
+
+		for(int d = 0; d < 3; d++) {
+			if(local[d] < lo[d]) lo[d] = local[d];
+			if(local[d] + 1 > hi[d]) hi[d] = local[d] + 1;
+		}
+	}
+
+	chunk_mesh->bounds = ChunkCellBox(origin, lo, hi, grid->cell_size);
+	ChunkFindOccluders(chunk_mesh, cells, origin, grid->cell_size);
+
+	// Neighbour shell from adjacent chunks, cells outside of grid read as air
+	for(int z = -1; z <= CHUNK_SIZE; z++) {
+		for(int y = -1; y <= CHUNK_SIZE; y++) {
+			for(int x = -1; x <= CHUNK_SIZE; x++) {
+				bool inside = (x >= 0 && x < CHUNK_SIZE && y >= 0 && y < CHUNK_SIZE && z >= 0 && z < CHUNK_SIZE);
+				if(inside) continue;
+
+				Coords neighbour = (Coords) { origin.c + x, origin.r + y, origin.t + z };
+				cells[PADDED(x, y, z)] = CellFlags(GridDataAt(grid, neighbour));
+			}
+		}
+	}
+
+	if(!ao_lut_ready) BuildAOTable();
+
+	MeshBuilder builder = { 0 };
+	uint16_t mask[CHUNK_SIZE][CHUNK_SIZE];
+
+	// Opaque cells of every padded plane along d, one row of u bits per v,
+	// bit i + 1 holds cell i
+	uint32_t planes[PADDED_SIZE][PADDED_SIZE];
+
+	for(int d = 0; d < 3; d++) {
+		int u = (d + 1) % 3;
+		int v = (d + 2) % 3;
+
+		for(int p = -1; p <= CHUNK_SIZE; p++) {
+			for(int j = -1; j <= CHUNK_SIZE; j++) {
+				uint32_t row = 0;
+
+				for(int i = -1; i <= CHUNK_SIZE; i++) {
+					int x[3];
+					x[d] = p, x[u] = i, x[v] = j;
+
+					if(cells[PADDED(x[0], x[1], x[2])] & CELL_OPAQUE) row |= 1u << (i + 1);
+				}
+
+				planes[p + 1][j + 1] = row;
+			}
+		}
+
+		for(int side = -1; side <= 1; side += 2) {
+			for(int k = 0; k < CHUNK_SIZE; k++) {
+				// Rows of plane in front of faces
+				uint32_t *front = planes[k + side + 1];
+
+				// Visible faces of slice k facing side:
+				// cube cells whose neighbour on that side does not hide them
+				for(int j = 0; j < CHUNK_SIZE; j++) {
+					for(int i = 0; i < CHUNK_SIZE; i++) {
+						int x[3];
+						x[d] = k, x[u] = i, x[v] = j;
+
+						uint8_t cell = cells[PADDED(x[0], x[1], x[2])];
+						bool hidden = (front[j + 1] >> (i + 1)) & 1;
+
+						if(!(cell & CELL_CUBE) || hidden) {
+							mask[j][i] = 0;
+							continue;
+						}
+
+						// 3x3 neighbourhood of the front cell minus its center, rows j - 1, j and j + 1
+						uint32_t below = (front[j] >> i) & 7;
+						uint32_t level = (front[j + 1] >> i) & 5;
+						uint32_t above = (front[j + 2] >> i) & 7;
+
+						uint8_t neighbours = below | (level & 1) << 3 | (level >> 2) << 4 | above << 5;
+						mask[j][i] = FACE_VISIBLE | ao_lut[neighbours];
+					}
+				}
+
+				GreedySlice(&builder, mask, d, side, k, origin, grid->cell_size);
+			}
+		}
+	}
+
+	if(!builder.quad_count) return;
+
+	Mesh mesh = { 0 };
+	mesh.vertexCount = builder.quad_count * 4;
+	mesh.triangleCount = builder.quad_count * 2;
+	mesh.vertices = builder.vertices;
+	mesh.normals = builder.normals;
+	mesh.texcoords = builder.texcoords;
+	mesh.colors = builder.colors;
+	mesh.indices = builder.indices;
+
+	UploadMesh(&mesh, false);
+	chunk_mesh->mesh = mesh;
+}
+
+void ChunkMeshFree(ChunkMesh *chunk_mesh) {
+	if(chunk_mesh->mesh.vaoId) 
+		UnloadMesh(chunk_mesh->mesh);
+
+	chunk_mesh->mesh = (Mesh) { 0 };
+}
+
+// Remesh chunks queued by GridMarkChunkDirty
+void GridUpdateMeshes(Grid *grid) {
+	for(int32_t i = 0; i < grid->dirty_count; i++) {
+		int32_t chunk_id = grid->dirty_chunks[i];
+
+		MeshChunk(grid, chunk_id);
+		grid->meshes[chunk_id].flags &= ~CHUNK_MESH_DIRTY;
+	}
+
+	grid->dirty_count = 0;
+}
+
+typedef struct {
+	Grid *grid;
+	LightHandler *handler;
+
+	int32_t *chunks;
+
+} BakeJob;
+
+// Rebake one chunk when its mesh is new or lights reaching it changed
+static void BakeChunkJob(void *ctx, int32_t index) {
+	BakeJob *job = ctx;
+	ChunkMesh *chunk_mesh = &job->grid->meshes[job->chunks[index]];
+
+	int32_t lights[MAX_LIGHTS];
+	int count = BakedLightsInBox(job->handler, chunk_mesh->bounds.min, chunk_mesh->bounds.max, lights);
+	uint32_t hash = BakedLightsHash(job->handler, lights, count);
+
+	bool unbaked = (chunk_mesh->flags & CHUNK_MESH_UNBAKED);
+	if(!unbaked && hash == chunk_mesh->bake_hash) return;
+
+	BakeVertexLights(job->handler, lights, count, &chunk_mesh->mesh);
+
+	// Items of a batch touch distinct chunks, flags need no locking
+	chunk_mesh->bake_hash = hash;
+	chunk_mesh->flags = (chunk_mesh->flags & ~CHUNK_MESH_UNBAKED) | CHUNK_MESH_REBAKED;
+}
+
+// Bake lighting into vertex colors of chunks that need it, spread over worker threads.
+// Baked lights cast no shadows, a cell edit only affects the chunks it remeshed
+void GridBakeLights(Grid *grid, LightHandler *handler) {
+	if(handler->mode != LIGHTING_BAKED) return;
+
+	// Every chunk is a candidate after a light change, otherwise only new meshes
+	bool lights_changed = (grid->bake_version != handler->version);
+	grid->bake_version = handler->version;
+
+	int32_t *chunks = NULL;
+	int32_t count = 0;
+
+	for(int32_t i = 0; i < grid->chunk_count; i++) {
+		ChunkMesh *chunk_mesh = &grid->meshes[i];
+
+		if(!chunk_mesh->mesh.vaoId) continue;
+		if(!lights_changed && !(chunk_mesh->flags & CHUNK_MESH_UNBAKED)) continue;
+
+		if(!chunks) chunks = malloc(sizeof(int32_t) * grid->chunk_count);
+		chunks[count++] = i;
+	}
+
+	if(!count) return;
+
+	BakeJob job = (BakeJob) { .grid = grid, .handler = handler, .chunks = chunks };
+	JobsParallelFor(BakeChunkJob, &job, count);
+
+	// GL calls stay on the main thread
+	for(int32_t i = 0; i < count; i++) {
+		ChunkMesh *chunk_mesh = &grid->meshes[chunks[i]];
+		if(!(chunk_mesh->flags & CHUNK_MESH_REBAKED)) continue;
+
+		UpdateMeshBuffer(chunk_mesh->mesh, RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, chunk_mesh->mesh.colors, chunk_mesh->mesh.vertexCount * 4, 0);
+		chunk_mesh->flags &= ~CHUNK_MESH_REBAKED;
+	}
+
+	free(chunks);
+}
+
+// Queue meshes of chunks that passed culling, each shaded only by lights reaching it
+void QueueChunkMeshes(Grid *grid, Material material, LightHandler *handler, RenderQueue *queue) {
+	for(int32_t i = 0; i < grid->visible_count; i++) {
+		ChunkMesh *chunk_mesh = &grid->meshes[grid->visible_chunks[i]];
+		if(!chunk_mesh->mesh.vaoId) continue;
+
+		// Baked chunks only need their vertex colors
+		if(handler->mode == LIGHTING_BAKED) {
+			Material baked = material;
+			baked.shader = handler->shader_baked;
+
+			RenderQueuePushMesh(queue, &chunk_mesh->mesh, baked, MatrixIdentity(), NULL, 0);
+			continue;
+		}
+
+		// Clustered shaders pick lights per fragment instead
+		if(handler->mode != LIGHTING_FORWARD) {
+			RenderQueuePushMesh(queue, &chunk_mesh->mesh, material, MatrixIdentity(), NULL, 0);
+			continue;
+		}
+
+		if(chunk_mesh->light_version != handler->version) {
+			chunk_mesh->light_count = LightsInBox(handler, chunk_mesh->bounds.min, chunk_mesh->bounds.max, chunk_mesh->lights);
+			chunk_mesh->light_version = handler->version;
+		}
+
+		// Variant unrolled for no more lights than reach the chunk
+		Material lit = material;
+		lit.shader = LightShaderForCount(handler, chunk_mesh->light_count);
+
+		// Vertices are already in world space
+		RenderQueuePushMesh(queue, &chunk_mesh->mesh, lit, MatrixIdentity(), chunk_mesh->lights, chunk_mesh->light_count);
+	}
+}
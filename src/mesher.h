@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include "raylib.h"
+#include "map.h"
+
+#ifndef MESHER_H_
+#define MESHER_H_
+
+// Blocks that fill their whole cell and are merged into chunk meshes,
+// everything else keeps its own model
+bool BlockIsCube(unsigned char data);
+
+// Blocks that hide faces of neighbouring cubes, water and corners let faces show through
+bool BlockIsOpaque(unsigned char data);
+
+void MeshChunk(Grid *grid, int32_t chunk_id);
+void ChunkMeshFree(ChunkMesh *chunk_mesh);
+
+void GridUpdateMeshes(Grid *grid);
+void GridBakeLights(Grid *grid, LightHandler *handler);
+void QueueChunkMeshes(Grid *grid, Material material, LightHandler *handler, RenderQueue *queue);
+
+#endif
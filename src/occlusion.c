@@ -0,0 +1,262 @@
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "frustum.h"
+#include "jobs.h"
+#include "occlusion.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void OcclusionInit(OcclusionBuffer *occ) {
+	*occ = (OcclusionBuffer) {
+		.depth = malloc(sizeof(float) * OCC_WIDTH * OCC_HEIGHT),
+		.quads = malloc(sizeof(OccluderQuad) * OCC_MAX_QUADS)
+	};
+}
+
+void OcclusionClose(OcclusionBuffer *occ) {
+	free(occ->depth);
+	free(occ->quads);
+
+	*occ = (OcclusionBuffer) { 0 };
+}
+
+void OcclusionBegin(OcclusionBuffer *occ, Camera3D camera, float aspect, float near, float far) {
+	occ->view_proj = FrustumViewProjection(camera, aspect, near, far);
+	occ->eye = camera.position;
+	occ->near = near;
+	occ->quad_count = 0;
+}
+
+// Transform world position to clip space, w holds view depth
+static Vector4 OcclusionProject(OcclusionBuffer *occ, Vector3 p) {
+	Matrix m = occ->view_proj;
+
+	return (Vector4) {
+		m.m0 * p.x + m.m4 * p.y + m.m8  * p.z + m.m12,
+		m.m1 * p.x + m.m5 * p.y + m.m9  * p.z + m.m13,
+		m.m2 * p.x + m.m6 * p.y + m.m10 * p.z + m.m14,
+		m.m3 * p.x + m.m7 * p.y + m.m11 * p.z + m.m15
+	};
+}
+
+// Clip space to depth buffer pixels, y points down
+static Vector2 OcclusionToScreen(Vector4 clip) {
+	return (Vector2) {
+		(clip.x / clip.w * 0.5f + 0.5f) * OCC_WIDTH,
+		(0.5f - clip.y / clip.w * 0.5f) * OCC_HEIGHT
+	};
+}
+
+static void OcclusionAddQuad(OcclusionBuffer *occ, Vector3 corners[4]) {
+	// Occluders are optional, extra ones are dropped
+	if(occ->quad_count >= OCC_MAX_QUADS) return;
+
+	Vector2 s[4];
+	float depth = 0;
+
+	for(int i = 0; i < 4; i++) {
+		Vector4 clip = OcclusionProject(occ, corners[i]);
+
+		// Crossing the near plane, skip instead of clipping
+		if(clip.w < occ->near) return;
+
+		s[i] = OcclusionToScreen(clip);
+		depth = fmaxf(depth, clip.w);
+	}
+
+	float area = 0;
+	for(int i = 0; i < 4; i++)
+		area += s[i].x * s[(i + 1) % 4].y - s[(i + 1) % 4].x * s[i].y;
+
+	// Seen edge on
+	if(fabsf(area) < 0.01f) return;
+
+	float sign = (area > 0) ? -1 : 1;
+
+	OccluderQuad quad = { .depth = depth };
+
+	Vector2 lo = s[0], hi = s[0];
+
+	for(int i = 0; i < 4; i++) {
+		Vector2 p0 = s[i];
+		Vector2 p1 = s[(i + 1) % 4];
+
+		float a = (p1.y - p0.y) * sign;
+		float b = (p0.x - p1.x) * sign;
+
+		// Evaluate at pixel centers, pulled in by half a pixel
+		// so only fully covered pixels pass
+		quad.a[i] = a;
+		quad.b[i] = b;
+		quad.c[i] = -(a * p0.x + b * p0.y) + 0.5f * (a + b) - 0.5f * (fabsf(a) + fabsf(b));
+
+		lo = Vector2Min(lo, p0);
+		hi = Vector2Max(hi, p0);
+	}
+
+	quad.min_x = Clamp(floorf(lo.x), 0, OCC_WIDTH);
+	quad.min_y = Clamp(floorf(lo.y), 0, OCC_HEIGHT);
+	quad.max_x = Clamp(ceilf(hi.x), 0, OCC_WIDTH);
+	quad.max_y = Clamp(ceilf(hi.y), 0, OCC_HEIGHT);
+
+	if(quad.min_x >= quad.max_x || quad.min_y >= quad.max_y) return;
+
+	occ->quads[occ->quad_count++] = quad;
+}
+
+void OcclusionAddBox(OcclusionBuffer *occ, Vector3 min, Vector3 max) {
+	float lo[3] = { min.x, min.y, min.z };
+	float hi[3] = { max.x, max.y, max.z };
+	float eye[3] = { occ->eye.x, occ->eye.y, occ->eye.z };
+
+	// Eye inside box, everything behind it is hidden but box can't be projected
+	if(eye[0] > lo[0] && eye[0] < hi[0] && eye[1] > lo[1] && eye[1] < hi[1] && eye[2] > lo[2] && eye[2] < hi[2])
+		return;
+
+	for(int d = 0; d < 3; d++) {
+		int u = (d + 1) % 3;
+		int v = (d + 2) % 3;
+
+		// Only faces whose outer side the eye is on
+		float plane;
+		if(eye[d] < lo[d]) plane = lo[d];
+		else if(eye[d] > hi[d]) plane = hi[d];
+		else continue;
+
+		float uv[4][2] = { { lo[u], lo[v] }, { hi[u], lo[v] }, { hi[u], hi[v] }, { lo[u], hi[v] } };
+
+		Vector3 corners[4];
+		for(int i = 0; i < 4; i++) {
+			float p[3];
+			p[d] = plane, p[u] = uv[i][0], p[v] = uv[i][1];
+
+			corners[i] = (Vector3) { p[0], p[1], p[2] };
+		}
+
+		OcclusionAddQuad(occ, corners);
+	}
+}
+
+static void OcclusionRasterQuadRow(float *row, OccluderQuad *quad, int32_t y) {
+	int32_t x = quad->min_x & ~3;
+
+#ifdef __SSE2__
+	__m128 lane = _mm_set_ps(3, 2, 1, 0);
+	__m128 depth = _mm_set1_ps(quad->depth);
+	__m128 zero = _mm_setzero_ps();
+
+	// Edge values of four pixels, stepped four pixels per iteration
+	__m128 e[4], step[4];
+	for(int i = 0; i < 4; i++) {
+		__m128 a = _mm_set1_ps(quad->a[i]);
+
+		e[i] = _mm_add_ps(_mm_set1_ps(quad->a[i] * x + quad->b[i] * y + quad->c[i]), _mm_mul_ps(a, lane));
+		step[i] = _mm_mul_ps(a, _mm_set1_ps(4));
+	}
+
+	for(; x < quad->max_x; x += 4) {
+		__m128 inside = _mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(e[2], zero), _mm_cmpge_ps(e[3], zero)));
+
+		__m128 old = _mm_loadu_ps(row + x);
+		__m128 nearest = _mm_min_ps(old, depth);
+		_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+
+		for(int i = 0; i < 4; i++)
+			e[i] = _mm_add_ps(e[i], step[i]);
+	}
+#else
+	for(; x < quad->max_x; x++) {
+		bool inside = true;
+
+		for(int i = 0; i < 4; i++)
+			inside &= (quad->a[i] * x + quad->b[i] * y + quad->c[i] >= 0);
+
+		if(inside && quad->depth < row[x]) row[x] = quad->depth;
+	}
+#endif
+}
+
+// Job: clear one band of rows and rasterize every quad overlapping it
+static void OcclusionRasterBand(void *ctx, int32_t band) {
+	OcclusionBuffer *occ = ctx;
+
+	int32_t y0 = band * OCC_BAND_ROWS;
+	int32_t y1 = y0 + OCC_BAND_ROWS;
+
+	for(int32_t i = y0 * OCC_WIDTH; i < y1 * OCC_WIDTH; i++)
+		occ->depth[i] = FLT_MAX;
+
+	for(int32_t q = 0; q < occ->quad_count; q++) {
+		OccluderQuad *quad = &occ->quads[q];
+
+		int32_t start = (quad->min_y > y0) ? quad->min_y : y0;
+		int32_t end = (quad->max_y < y1) ? quad->max_y : y1;
+
+		for(int32_t y = start; y < end; y++)
+			OcclusionRasterQuadRow(occ->depth + y * OCC_WIDTH, quad, y);
+	}
+}
+
+void OcclusionRasterize(OcclusionBuffer *occ) {
+	JobsParallelFor(OcclusionRasterBand, occ, OCC_HEIGHT / OCC_BAND_ROWS);
+}
+
+bool OcclusionTestBox(OcclusionBuffer *occ, Vector3 min, Vector3 max) {
+	Vector2 lo = { FLT_MAX, FLT_MAX };
+	Vector2 hi = { -FLT_MAX, -FLT_MAX };
+	float nearest = FLT_MAX;
+
+	for(int i = 0; i < 8; i++) {
+		Vector3 corner = (Vector3) { (i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z };
+		Vector4 clip = OcclusionProject(occ, corner);
+
+		// Box reaches behind the near plane, treat as visible
+		if(clip.w < occ->near) return true;
+
+		Vector2 s = OcclusionToScreen(clip);
+		lo = Vector2Min(lo, s);
+		hi = Vector2Max(hi, s);
+		nearest = fminf(nearest, clip.w);
+	}
+
+	int32_t x0 = Clamp(floorf(lo.x), 0, OCC_WIDTH);
+	int32_t y0 = Clamp(floorf(lo.y), 0, OCC_HEIGHT);
+	int32_t x1 = Clamp(ceilf(hi.x), 0, OCC_WIDTH);
+	int32_t y1 = Clamp(ceilf(hi.y), 0, OCC_HEIGHT);
+
+	if(x0 >= x1 || y0 >= y1) return true;
+
+	// Visible if any covered pixel has no occluder in front of the box
+	for(int32_t y = y0; y < y1; y++) {
+		float *row = occ->depth + y * OCC_WIDTH;
+		int32_t x = x0 & ~3;
+
+#ifdef __SSE2__
+		__m128 box_depth = _mm_set1_ps(nearest);
+		__m128 lane = _mm_set_ps(3, 2, 1, 0);
+		__m128 first = _mm_set1_ps(x0);
+		__m128 last = _mm_set1_ps(x1);
+
+		for(; x < x1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps(x), lane);
+			__m128 in_rect = _mm_and_ps(_mm_cmpge_ps(px, first), _mm_cmplt_ps(px, last));
+
+			__m128 open = _mm_cmpge_ps(_mm_loadu_ps(row + x), box_depth);
+
+			if(_mm_movemask_ps(_mm_and_ps(in_rect, open))) return true;
+		}
+#else
+		for(x = x0; x < x1; x++) {
+			if(row[x] >= nearest) return true;
+		}
+#endif
+	}
+
+	return false;
+}
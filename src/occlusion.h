@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "raylib.h"
+
+#ifndef OCCLUSION_H_
+#define OCCLUSION_H_
+
+// Resolution of software depth buffer, width must be a multiple of 4
+#define OCC_WIDTH		256
+#define OCC_HEIGHT		128
+
+// Rows rasterized per job
+#define OCC_BAND_ROWS	16
+
+#define OCC_MAX_QUADS	2048
+
+// Nearest visible chunks whose occluder boxes are rasterized
+#define OCC_OCCLUDER_CHUNKS	32
+
+// Screen space convex quad of an occluder face, set up once and rasterized by every band
+typedef struct {
+	// Edge functions a * x + b * y + c at pixel (x, y),
+	// non-negative only when the whole pixel lies inside the edge
+	float a[4];
+	float b[4];
+	float c[4];
+
+	// Farthest view depth of the quad's corners
+	float depth;
+
+	// Pixel bounds, max exclusive
+	int16_t min_x, min_y;
+	int16_t max_x, max_y;
+
+} OccluderQuad;
+
+typedef struct {
+	// View depth of nearest occluder per pixel
+	float *depth;
+
+	OccluderQuad *quads;
+	int32_t quad_count;
+
+	Matrix view_proj;
+	Vector3 eye;
+
+	float near;
+
+} OcclusionBuffer;
+
+void OcclusionInit(OcclusionBuffer *occ);
+void OcclusionClose(OcclusionBuffer *occ);
+
+// Reset occluders for a new frame
+void OcclusionBegin(OcclusionBuffer *occ, Camera3D camera, float aspect, float near, float far);
+
+// Queue faces of a solid box that face the camera
+void OcclusionAddBox(OcclusionBuffer *occ, Vector3 min, Vector3 max);
+
+// Clear depth buffer and rasterize queued occluders, one band per job
+void OcclusionRasterize(OcclusionBuffer *occ);
+
+// Returns false only when box is hidden behind rasterized occluders
+bool OcclusionTestBox(OcclusionBuffer *occ, Vector3 min, Vector3 max);
+
+#endif
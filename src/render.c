@@ -0,0 +1,185 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "lights.h"
+#include "render.h"
+
+void UniformCacheReset(UniformCache *cache) {
+	cache->count = 0;
+}
+
+static int UniformSize(int type) {
+	switch(type) {
+		case SHADER_UNIFORM_VEC2:	return sizeof(float) * 2;
+		case SHADER_UNIFORM_VEC3:	return sizeof(float) * 3;
+		case SHADER_UNIFORM_VEC4:	return sizeof(float) * 4;
+		case SHADER_UNIFORM_IVEC2:	return sizeof(int) * 2;
+		case SHADER_UNIFORM_IVEC3:	return sizeof(int) * 3;
+		case SHADER_UNIFORM_IVEC4:	return sizeof(int) * 4;
+	}
+
+	// Float, int and sampler
+	return sizeof(int);
+}
+
+// Find slot of location, claiming a free one when missing, NULL when cache is full
+static UniformSlot *UniformCacheSlot(UniformCache *cache, int loc) {
+	for(int i = 0; i < cache->count; i++) {
+		if(cache->slots[i].loc == loc) return &cache->slots[i];
+	}
+
+	if(cache->count >= UNIFORM_CACHE_SLOTS) return NULL;
+
+	UniformSlot *slot = &cache->slots[cache->count++];
+	slot->loc = loc;
+	slot->size = -1;	// No value uploaded yet
+
+	return slot;
+}
+
+void UniformCacheSet(UniformCache *cache, Shader shader, int loc, const void *value, int type) {
+	UniformCacheSetV(cache, shader, loc, value, type, 1);
+}
+
+// Arrays larger than a slot are uploaded without caching
+void UniformCacheSetV(UniformCache *cache, Shader shader, int loc, const void *value, int type, int count) {
+	if(loc < 0) return;
+
+	int size = UniformSize(type) * count;
+	UniformSlot *slot = (size <= (int)sizeof(Matrix)) ? UniformCacheSlot(cache, loc) : NULL;
+
+	if(slot && slot->size == size && !memcmp(slot->value, value, size)) return;
+
+	SetShaderValueV(shader, loc, value, type, count);
+
+	if(slot) {
+		slot->size = size;
+		memcpy(slot->value, value, size);
+	}
+}
+
+void UniformCacheSetMatrix(UniformCache *cache, Shader shader, int loc, Matrix mat) {
+	if(loc < 0) return;
+
+	UniformSlot *slot = UniformCacheSlot(cache, loc);
+
+	if(slot && slot->size == sizeof(Matrix) && !memcmp(slot->value, &mat, sizeof(Matrix))) return;
+
+	SetShaderValueMatrix(shader, loc, mat);
+
+	if(slot) {
+		slot->size = sizeof(Matrix);
+		memcpy(slot->value, &mat, sizeof(Matrix));
+	}
+}
+
+Matrix MatrixRotateY90(uint8_t rotation) {
+	// cos and sin of 0, 90, 180 and 270 degrees
+	const float cos_table[4] = { 1, 0, -1, 0 };
+	const float sin_table[4] = { 0, 1, 0, -1 };
+
+	float c = cos_table[rotation & 3];
+	float s = sin_table[rotation & 3];
+
+	// Same layout as MatrixRotateY
+	return (Matrix) {
+		 c, 0, s, 0,
+		 0, 1, 0, 0,
+		-s, 0, c, 0,
+		 0, 0, 0, 1
+	};
+}
+
+Matrix NormalMatrix(Matrix transform) {
+	Matrix rotation = transform;
+	rotation.m12 = rotation.m13 = rotation.m14 = 0;
+
+	Vector3 x = (Vector3) { transform.m0, transform.m1, transform.m2 };
+	Vector3 y = (Vector3) { transform.m4, transform.m5, transform.m6 };
+	Vector3 z = (Vector3) { transform.m8, transform.m9, transform.m10 };
+
+	// Orthonormal axes, the inverse transpose is the matrix itself
+	const float epsilon = 1e-4f;
+	bool rigid = (fabsf(Vector3DotProduct(x, x) - 1) < epsilon && fabsf(Vector3DotProduct(y, y) - 1) < epsilon &&
+		fabsf(Vector3DotProduct(z, z) - 1) < epsilon && fabsf(Vector3DotProduct(x, y)) < epsilon &&
+		fabsf(Vector3DotProduct(x, z)) < epsilon && fabsf(Vector3DotProduct(y, z)) < epsilon);
+
+	if(rigid) return rotation;
+
+	return MatrixTranspose(MatrixInvert(rotation));
+}
+
+uint64_t RenderKey(Material material, Mesh *mesh, uint8_t rotation) {
+	uint64_t shader = material.shader.id & 0xffff;
+	uint64_t texture = material.maps[MATERIAL_MAP_DIFFUSE].texture.id & 0xffff;
+	uint64_t vao = mesh->vaoId & 0xffffff;
+
+	return (shader << 48 | texture << 32 | vao << 8 | rotation);
+}
+
+static RenderItem *RenderQueueAdd(RenderQueue *queue) {
+	if(queue->count >= queue->cap) {
+		queue->cap = (queue->cap) ? queue->cap * 2 : 64;
+		queue->items = realloc(queue->items, sizeof(RenderItem) * queue->cap);
+	}
+
+	return &queue->items[queue->count++];
+}
+
+void RenderQueuePushMesh(RenderQueue *queue, Mesh *mesh, Material material, Matrix transform, const int32_t *lights, int32_t light_count) {
+	*RenderQueueAdd(queue) = (RenderItem) {
+		.key = RenderKey(material, mesh, 0),
+		.mesh = mesh,
+		.material = material,
+		.transform = transform,
+		.lights = lights,
+		.light_count = light_count,
+		.type = RITEM_MESH
+	};
+}
+
+void RenderQueuePushInstanced(RenderQueue *queue, Mesh *mesh, Material material, Matrix *transforms, int32_t count, uint8_t rotation) {
+	*RenderQueueAdd(queue) = (RenderItem) {
+		.key = RenderKey(material, mesh, rotation),
+		.mesh = mesh,
+		.material = material,
+		.transforms = transforms,
+		.instance_count = count,
+		.type = RITEM_INSTANCED
+	};
+}
+
+static int RenderItemCompare(const void *a, const void *b) {
+	uint64_t ka = ((const RenderItem*)a)->key;
+	uint64_t kb = ((const RenderItem*)b)->key;
+
+	return (ka > kb) - (ka < kb);
+}
+
+void RenderQueueFlush(RenderQueue *queue) {
+	qsort(queue->items, queue->count, sizeof(RenderItem), RenderItemCompare);
+
+	for(int32_t i = 0; i < queue->count; i++) {
+		RenderItem *item = &queue->items[i];
+
+		switch(item->type) {
+			case RITEM_MESH:
+				SetDrawLights(item->material.shader, item->lights, item->light_count);
+				DrawMeshShaded(*item->mesh, item->material, item->transform);
+				break;
+
+			case RITEM_INSTANCED:
+				DrawMeshInstanced(*item->mesh, item->material, item->transforms, item->instance_count);
+				break;
+		}
+	}
+
+	queue->count = 0;
+}
+
+void RenderQueueFree(RenderQueue *queue) {
+	free(queue->items);
+	*queue = (RenderQueue) { 0 };
+}
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include "raylib.h"
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#define UNIFORM_CACHE_SLOTS	16
+
+// Last value uploaded to a uniform location
+typedef struct {
+	int loc;
+	int size;
+
+	unsigned char value[sizeof(Matrix)];
+
+} UniformSlot;
+
+// Per shader record of uploaded uniform values, lets unchanged values skip SetShaderValue,
+// only valid while every upload of a cached location goes through it
+typedef struct {
+	UniformSlot slots[UNIFORM_CACHE_SLOTS];
+	int count;
+
+} UniformCache;
+
+void UniformCacheReset(UniformCache *cache);
+void UniformCacheSet(UniformCache *cache, Shader shader, int loc, const void *value, int type);
+void UniformCacheSetV(UniformCache *cache, Shader shader, int loc, const void *value, int type, int count);
+void UniformCacheSetMatrix(UniformCache *cache, Shader shader, int loc, Matrix mat);
+
+// Exact rotation about Y by rotation * 90 degrees, rotation in 0..3
+Matrix MatrixRotateY90(uint8_t rotation);
+
+// Transform for normals, rotation part of rigid transforms, inverse transpose otherwise
+Matrix NormalMatrix(Matrix transform);
+
+enum RENDER_ITEM_TYPES : uint8_t {
+	RITEM_MESH,			// Single mesh with model matrix
+	RITEM_INSTANCED		// Mesh drawn once per transform
+};
+
+typedef struct {
+	// Shader, texture, mesh and rotation packed from most to least significant
+	uint64_t key;
+
+	Mesh *mesh;
+	Material material;
+
+	Matrix transform;
+
+	// Mesh items only, lights shading the item, NULL for all lights
+	const int32_t *lights;
+	int32_t light_count;
+
+	// Instanced items only, must stay valid until flush
+	Matrix *transforms;
+	int32_t instance_count;
+
+	uint8_t type;
+
+} RenderItem;
+
+// Draws collected over a frame, submitted sorted by state to minimize switches
+typedef struct {
+	RenderItem *items;
+
+	int32_t count;
+	int32_t cap;
+
+} RenderQueue;
+
+uint64_t RenderKey(Material material, Mesh *mesh, uint8_t rotation);
+
+void RenderQueuePushMesh(RenderQueue *queue, Mesh *mesh, Material material, Matrix transform, const int32_t *lights, int32_t light_count);
+void RenderQueuePushInstanced(RenderQueue *queue, Mesh *mesh, Material material, Matrix *transforms, int32_t count, uint8_t rotation);
+
+// Sort queued items by key, draw them and empty the queue
+void RenderQueueFlush(RenderQueue *queue);
+void RenderQueueFree(RenderQueue *queue);
+
+#endif
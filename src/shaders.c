@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "raylib.h"
+#include "rlgl.h"
+#include "external/glad.h"
+#include "shaders.h"
+
+// Loaded program binary header
+typedef struct {
+	uint32_t magic;
+	uint32_t format;
+	int32_t length;
+
+} ShaderCacheHeader;
+
+#define SHADER_CACHE_MAGIC	0x52444853	// "SHDR"
+
+ShaderVariant shader_variants[SHADER_MAX_VARIANTS];
+int shader_variant_count;
+
+static uint64_t HashString(uint64_t hash, const char *text) {
+	// FNV-1a
+	for(; text && *text; text++) {
+		hash ^= (unsigned char)*text;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// Source with defines placed after its #version line, caller frees
+static char *InjectDefines(const char *source, const char *defines) {
+	size_t split = 0;
+
+	if(!strncmp(source, "#version", 8)) {
+		const char *end = strchr(source, '\n');
+		split = (end) ? (size_t)(end - source) + 1 : strlen(source);
+	}
+
+	size_t defines_len = strlen(defines);
+	size_t source_len = strlen(source);
+
+	char *out = malloc(source_len + defines_len + 2);
+
+	memcpy(out, source, split);
+	memcpy(out + split, defines, defines_len);
+	out[split + defines_len] = '\n';
+	memcpy(out + split + defines_len + 1, source + split, source_len - split + 1);
+
+	return out;
+}
+
+static bool ProgramBinarySupported() {
+	static int supported = -1;
+
+	if(supported < 0) {
+		GLint formats = 0;
+		if(GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+		supported = (formats > 0);
+	}
+
+	return supported;
+}
+
+// Binaries only load on the driver that wrote them, name files by driver too
+static const char *ShaderCachePath(uint64_t key) {
+	uint64_t hash = HashString(key, (const char *)glGetString(GL_RENDERER));
+	hash = HashString(hash, (const char *)glGetString(GL_VERSION));
+
+	return TextFormat("%s/%016llx.bin", SHADER_CACHE_DIR, (unsigned long long)hash);
+}
+
+// Default locations by raylib's default names, same as LoadShaderFromMemory assigns,
+// attributes are bound to raylib's default attribute slots before linking
+static const struct { int loc; const char *name; bool attrib; int slot; } default_locs[] = {
+	{ SHADER_LOC_VERTEX_POSITION, "vertexPosition", true, RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION },
+	{ SHADER_LOC_VERTEX_TEXCOORD01, "vertexTexCoord", true, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD },
+	{ SHADER_LOC_VERTEX_TEXCOORD02, "vertexTexCoord2", true, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD2 },
+	{ SHADER_LOC_VERTEX_NORMAL, "vertexNormal", true, RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL },
+	{ SHADER_LOC_VERTEX_TANGENT, "vertexTangent", true, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TANGENT },
+	{ SHADER_LOC_VERTEX_COLOR, "vertexColor", true, RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR },
+	{ SHADER_LOC_VERTEX_INSTANCE_TX, "instanceTransform", true, RL_DEFAULT_SHADER_ATTRIB_LOCATION_INSTANCE_TX },
+	{ SHADER_LOC_MATRIX_MVP, "mvp", false, -1 },
+	{ SHADER_LOC_MATRIX_VIEW, "matView", false, -1 },
+	{ SHADER_LOC_MATRIX_PROJECTION, "matProjection", false, -1 },
+	{ SHADER_LOC_MATRIX_MODEL, "matModel", false, -1 },
+	{ SHADER_LOC_MATRIX_NORMAL, "matNormal", false, -1 },
+	{ SHADER_LOC_COLOR_DIFFUSE, "colDiffuse", false, -1 },
+	{ SHADER_LOC_MAP_DIFFUSE, "texture0", false, -1 },
+	{ SHADER_LOC_MAP_SPECULAR, "texture1", false, -1 },
+	{ SHADER_LOC_MAP_NORMAL, "texture2", false, -1 }
+};
+
+static int *ShaderDefaultLocs(unsigned int id) {
+	int *locs = calloc(RL_MAX_SHADER_LOCATIONS, sizeof(int));
+
+	for(int i = 0; i < RL_MAX_SHADER_LOCATIONS; i++) 
+		locs[i] = -1;
+
+	for(size_t i = 0; i < sizeof(default_locs) / sizeof(default_locs[0]); i++) {
+		locs[default_locs[i].loc] = (default_locs[i].attrib) ? 
+			rlGetLocationAttrib(id, default_locs[i].name) : rlGetLocationUniform(id, default_locs[i].name);
+	}
+
+	return locs;
+}
+
+// Compile and link like rlLoadShaderProgram, plus the retrievable hint some drivers
+// need before they hand out a program binary, 0 on failure
+static unsigned int ShaderLinkProgram(const char *vs_code, const char *fs_code) {
+	unsigned int vs = rlCompileShader(vs_code, RL_VERTEX_SHADER);
+	unsigned int fs = rlCompileShader(fs_code, RL_FRAGMENT_SHADER);
+
+	GLuint id = 0;
+	GLint linked = 0;
+
+	if(vs && fs) {
+		id = glCreateProgram();
+		glAttachShader(id, vs);
+		glAttachShader(id, fs);
+
+		for(size_t i = 0; i < sizeof(default_locs) / sizeof(default_locs[0]); i++) {
+			if(default_locs[i].attrib) glBindAttribLocation(id, default_locs[i].slot, default_locs[i].name);
+		}
+
+		if(ProgramBinarySupported()) glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+		glLinkProgram(id);
+		glGetProgramiv(id, GL_LINK_STATUS, &linked);
+
+		if(!linked) {
+			char log[1024] = "";
+			glGetProgramInfoLog(id, sizeof(log), NULL, log);
+			printf("ERROR: could not link shader variant: %s\n", log);
+		}
+
+		glDetachShader(id, vs);
+		glDetachShader(id, fs);
+	}
+
+	if(vs) glDeleteShader(vs);
+	if(fs) glDeleteShader(fs);
+
+	if(!linked) {
+		if(id) glDeleteProgram(id);
+		return 0;
+	}
+
+	return id;
+}
+
+// Link program from a cached binary, false when missing or rejected by the driver
+static bool ShaderCacheLoad(uint64_t key, Shader *shader) {
+	if(!ProgramBinarySupported()) return false;
+
+	const char *path = ShaderCachePath(key);
+	if(!FileExists(path)) return false;
+
+	int size = 0;
+	unsigned char *data = LoadFileData(path, &size);
+	if(!data) return false;
+
+	ShaderCacheHeader *header = (ShaderCacheHeader*)data;
+	bool valid = (size >= (int)sizeof(ShaderCacheHeader) && header->magic == SHADER_CACHE_MAGIC && 
+		header->length == size - (int)sizeof(ShaderCacheHeader));
+
+	GLint linked = 0;
+	GLuint id = 0;
+
+	if(valid) {
+		id = glCreateProgram();
+		glProgramBinary(id, header->format, data + sizeof(ShaderCacheHeader), header->length);
+		glGetProgramiv(id, GL_LINK_STATUS, &linked);
+	}
+
+	UnloadFileData(data);
+
+	if(!linked) {
+		if(id) glDeleteProgram(id);
+		return false;
+	}
+
+	shader->id = id;
+	shader->locs = ShaderDefaultLocs(id);
+
+	return true;
+}
+
+static void ShaderCacheStore(uint64_t key, Shader shader) {
+	if(!ProgramBinarySupported()) return;
+
+	GLint length = 0;
+	glGetProgramiv(shader.id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	// Every later variant would fail the same way, one line is enough to explain a cold cache
+	if(length <= 0) {
+		static bool reported = false;
+		if(!reported) printf("ERROR: driver returned no program binary, shader cache not written\n");
+
+		reported = true;
+		return;
+	}
+
+	unsigned char *data = malloc(sizeof(ShaderCacheHeader) + length);
+	ShaderCacheHeader *header = (ShaderCacheHeader*)data;
+
+	GLenum format = 0;
+	glGetProgramBinary(shader.id, length, &length, &format, data + sizeof(ShaderCacheHeader));
+
+	*header = (ShaderCacheHeader) {
+		.magic = SHADER_CACHE_MAGIC,
+		.format = format,
+		.length = length
+	};
+
+	if(!DirectoryExists(SHADER_CACHE_DIR)) MakeDirectory(SHADER_CACHE_DIR);
+	if(!SaveFileData(ShaderCachePath(key), data, sizeof(ShaderCacheHeader) + length))
+		printf("ERROR: could not write shader cache to %s\n", SHADER_CACHE_DIR);
+
+	free(data);
+}
+
+Shader LoadShaderVariant(const char *vs_path, const char *fs_path, const char *defines) {
+	char *vs_source = LoadFileText(vs_path);
+	char *fs_source = LoadFileText(fs_path);
+
+	if(!vs_source || !fs_source) {
+		printf("ERROR: could not read shader variant of %s, %s\n", vs_path, fs_path);
+
+		UnloadFileText(vs_source);
+		UnloadFileText(fs_source);
+
+		return (Shader) { rlGetShaderIdDefault(), rlGetShaderLocsDefault() };
+	}
+
+	// Keyed by content, edited sources get new variants and cache files
+	uint64_t key = HashString(14695981039346656037ull, vs_source);
+	key = HashString(key, "\n//fs\n");
+	key = HashString(key, fs_source);
+	key = HashString(key, "\n//defines\n");
+	key = HashString(key, defines);
+
+	Shader shader = { 0 };
+	bool found = false;
+
+	for(int i = 0; i < shader_variant_count && !found; i++) {
+		if(shader_variants[i].key != key) continue;
+
+		shader = shader_variants[i].shader;
+		found = true;
+	}
+
+	if(!found && !ShaderCacheLoad(key, &shader)) {
+		char *vs_code = InjectDefines(vs_source, defines);
+		char *fs_code = InjectDefines(fs_source, defines);
+
+		unsigned int id = ShaderLinkProgram(vs_code, fs_code);
+
+		// Failed compiles fall back to raylib's default shader, nothing worth caching
+		if(id) {
+			shader = (Shader) { id, ShaderDefaultLocs(id) };
+			ShaderCacheStore(key, shader);
+		} else
+			shader = (Shader) { rlGetShaderIdDefault(), rlGetShaderLocsDefault() };
+
+		free(vs_code);
+		free(fs_code);
+	}
+
+	UnloadFileText(vs_source);
+	UnloadFileText(fs_source);
+
+	if(found) return shader;
+
+	if(shader_variant_count < SHADER_MAX_VARIANTS)
+		shader_variants[shader_variant_count++] = (ShaderVariant) { key, shader };
+	else
+		printf("ERROR: shader variant limit of %d reached, variant not cached\n", SHADER_MAX_VARIANTS);
+
+	return shader;
+}
+
+void UnloadShaderVariants() {
+	for(int i = 0; i < shader_variant_count; i++)
+		UnloadShader(shader_variants[i].shader);
+
+	shader_variant_count = 0;
+}
@@ -0,0 +1,24 @@
+#include <stdint.h>
+#include "raylib.h"
+
+#ifndef SHADERS_H_
+#define SHADERS_H_
+
+#define SHADER_MAX_VARIANTS	64
+
+// Linked program binaries, reused across runs when the driver supports it
+#define SHADER_CACHE_DIR	"cache/shaders"
+
+// Compiled specialization of a shader pair
+typedef struct {
+	uint64_t key;	// Hash of both sources and defines
+	Shader shader;
+
+} ShaderVariant;
+
+// Shader pair specialized by defines, e.g. "#define LIGHT_COUNT 4\n", inserted after #version.
+// Compiled on first request and kept until UnloadShaderVariants, never unload the result directly
+Shader LoadShaderVariant(const char *vs_path, const char *fs_path, const char *defines);
+void UnloadShaderVariants();
+
+#endif
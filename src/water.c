@@ -1,32 +1,175 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 #include "water.h"
 
+int water_scroll_loc;
+int water_offset_loc;
+int water_filter_loc;
+
+// CPU path kernel, picked at init
+WaterKernel water_kernel;
+
+// Shader path, falls back to CPU when the shader does not compile
+static void WaterInitGPU(WaterBackground *bg) {
+	bg->shader = LoadShader(
+		TextFormat("resources/shaders/deferred_quad_v.glsl"),
+		TextFormat("resources/shaders/water_f.glsl")
+	);
+
+	if(bg->shader.id == rlGetShaderIdDefault()) {
+		printf("ERROR: water shader failed to load, using CPU path\n");
+		bg->mode = WATER_CPU;
+		return;
+	}
+
+	water_scroll_loc = GetShaderLocation(bg->shader, "scroll");
+	water_offset_loc = GetShaderLocation(bg->shader, "offset");
+	water_filter_loc = GetShaderLocation(bg->shader, "water_filter");
+
+	Image noise = (Image) {
+		.data = bg->noise,
+		.width = WATER_SIZE,
+		.height = WATER_SIZE,
+		.mipmaps = 1,
+		.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+	};
+
+	bg->noise_tex = LoadTextureFromImage(noise);
+	SetTextureFilter(bg->noise_tex, TEXTURE_FILTER_POINT);
+
+	// Render target replaces the uploaded texture, one channel like the CPU output
+	UnloadTexture(bg->output);
+
+	bg->target.id = rlLoadFramebuffer();
+	bg->target.texture = (Texture2D) {
+		.id = rlLoadTexture(NULL, WATER_SIZE, WATER_SIZE, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE, 1),
+		.width = WATER_SIZE,
+		.height = WATER_SIZE,
+		.mipmaps = 1,
+		.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+	};
+
+	rlFramebufferAttach(bg->target.id, bg->target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+	if(!rlFramebufferComplete(bg->target.id))
+		printf("ERROR: water render target is not complete\n");
+
+	bg->output = bg->target.texture;
+	SetTextureWrap(bg->output, TEXTURE_WRAP_REPEAT);
+
+	bg->flags |= WATER_DIRTY;
+}
+
+static void WaterInitCache(WaterBackground *bg) {
+	WaterCache *cache = &bg->cache;
+
+	uint32_t budget = (bg->cache_mb) ? bg->cache_mb : WATER_CACHE_DEFAULT_MB;
+	size_t frames = ((size_t)budget * 1024 * 1024) / PX_COUNT;
+
+	cache->frame_count = (frames < WATER_PERIOD) ? frames : WATER_PERIOD;
+	cache->frames = calloc(cache->frame_count, sizeof(Texture2D));
+	cache->baked = calloc(cache->frame_count, sizeof(uint8_t));
+	cache->filter = bg->filter;
+	cache->live = bg->output;
+
+	if(cache->frame_count < WATER_PERIOD)
+		printf("water cache: %d of %d ticks fit in %u MB\n", cache->frame_count, WATER_PERIOD, budget);
+}
+
+// Swap output to this tick's frame, false when it needs computing
+static bool WaterCachePlay(WaterBackground *bg) {
+	WaterCache *cache = &bg->cache;
+
+	// Filter keys changed the output, every frame bakes again on its next tick
+	if(bg->filter != cache->filter) {
+		memset(cache->baked, 0, cache->frame_count);
+		cache->filter = bg->filter;
+	}
+
+	uint16_t tick = bg->scroll_x;
+	if(tick >= cache->frame_count || !cache->baked[tick]) return false;
+
+	bg->output = cache->frames[tick];
+	return true;
+}
+
+// Upload computed tick into its frame, or the live texture past the budget
+static void WaterCacheStore(WaterBackground *bg) {
+	WaterCache *cache = &bg->cache;
+	uint16_t tick = bg->scroll_x;
+
+	if(tick >= cache->frame_count) {
+		UpdateTexture(cache->live, bg->output_px);
+		bg->output = cache->live;
+		return;
+	}
+
+	Texture2D *frame = &cache->frames[tick];
+
+	if(!frame->id) {
+		Image image = (Image) {
+			.data = bg->output_px,
+			.width = WATER_SIZE,
+			.height = WATER_SIZE,
+			.mipmaps = 1,
+			.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+		};
+
+		*frame = LoadTextureFromImage(image);
+		SetTextureWrap(*frame, TEXTURE_WRAP_REPEAT);
+	} else
+		UpdateTexture(*frame, bg->output_px);
+
+	cache->baked[tick] = 1;
+	bg->output = *frame;
+}
+
 void WaterInit(WaterBackground *bg) {
+	water_kernel = WaterKernelSelect();
+
 	bg->scroll_x = 0, bg->scroll_y = 0;
 	bg->offset = 213;
 	bg->timer = 0.0f;
 	bg->filter = 0.86f;
 
 	bg->noise = (uint8_t*)malloc(PX_COUNT);
-	bg->output_px = (Color*)malloc(sizeof(Color) * PX_COUNT);
+	bg->output_px = (uint8_t*)malloc(PX_COUNT);
 
 	Image img = LoadImage("resources/water_noise.png");
 	Color *px = LoadImageColors(img);
 
-	for(uint32_t i = 0; i < PX_COUNT; i++) {
+	for(uint32_t i = 0; i < PX_COUNT; i++)
 		bg->noise[i] = (uint8_t)px[i].r;
-		bg->output_px[i] = px[i];
-	}
 
-	bg->output = LoadTextureFromImage(img);
+	UnloadImage(img);
+	free(px);
+
+	// First tick, shown until the timer runs out
+	water_kernel(bg, 0, WATER_SIZE);
+
+	Image output = (Image) {
+		.data = bg->output_px,
+		.width = WATER_SIZE,
+		.height = WATER_SIZE,
+		.mipmaps = 1,
+		.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+	};
+
+	bg->output = LoadTextureFromImage(output);
 	SetTextureWrap(bg->output, TEXTURE_WRAP_REPEAT);
 	//GenTextureMipmaps(&bg->output);
 	//SetTextureFilter(bg->output, TEXTURE_FILTER_TRILINEAR);
 
-	UnloadImage(img);
-	free(px);
+	if(bg->mode == WATER_GPU) WaterInitGPU(bg);
+	if(bg->mode == WATER_CACHED) WaterInitCache(bg);
+}
+
+static void WaterBandJob(void *ctx, int32_t band) {
+	WaterBackground *bg = ctx;
+	water_kernel(bg, band * WATER_BAND_ROWS, (band + 1) * WATER_BAND_ROWS);
 }
 
 void WaterUpdate(WaterBackground *bg, float dt) {
@@ -41,38 +184,69 @@ void WaterUpdate(WaterBackground *bg, float dt) {
 
 	bg->scroll_x = (bg->scroll_x + 1) % 512;
 	bg->scroll_y = (bg->scroll_y + 1) % 512;
+	bg->timer = 0.0175f;
 
-	for(uint32_t i = 0; i < PX_COUNT; i++) {
-		uint32_t x = ((i % 512) + bg->scroll_x) % 512; 
-		uint32_t y = ((i / 512) + bg->scroll_y) % 512;
-		uint32_t idxA = (x + y * 512);
-
-		//uint32_t offx = (bg->scroll_x - (((i % 512) - bg->offset) - bg->scroll_x)) % 512;
-		//uint32_t offy = (bg->scroll_y - (((i / 512) - bg->offset) - bg->scroll_y)) % 512;
-		uint32_t offx = ((i % 512) - bg->scroll_x + bg->offset) % 512;
-		uint32_t offy = ((i / 512) - bg->scroll_y - bg->offset) % 512;
-		uint32_t idxB = (offx + offy * 512);
-
-		//float val = Clamp(((bg->noise[idxA] + bg->noise[idxB]) * bg->filter), 0, 255);
-		float val = Clamp(((bg->noise[idxA] + bg->noise[idxB]) * bg->filter), 0, 255);
-		Color processed = (Color){val, val, val, val};
-		//Color processed = (Color){0, 100, 255, 0};
-
-		float intensity = val / 255.0f;
-
-		//if(intensity >= bg->filter) processed = (Color) { 0, 0, 0, 0 };
-		//if(intensity > 0.85f) processed = (Color) { 255, 255, 255, 150 };
-		
-		if(intensity > 0.79f) processed = (Color) { 0, 0, 0, 100 };
-		if(intensity > 0.99f) processed = (Color) { 240, 240, 250, 100};
-		
-		//if(intensity >= 0.95f) processed.a = 250;
-
-		bg->output_px[i] = processed;
+	// Drawn by WaterRender
+	if(bg->mode == WATER_GPU) {
+		bg->flags |= WATER_DIRTY;
+		return;
+	}
+
+	// Replayed ticks cost a texture swap
+	if(bg->mode == WATER_CACHED && WaterCachePlay(bg)) return;
+
+	// Bands only read noise and tick state, nothing touches them until WaterFinish
+	JobsSubmit(&bg->batch, WaterBandJob, bg, WATER_SIZE / WATER_BAND_ROWS);
+	bg->flags |= WATER_PENDING;
+}
+
+void WaterFinish(WaterBackground *bg) {
+	if(!(bg->flags & WATER_PENDING)) return;
+
+	JobsWait(&bg->batch);
+	bg->flags &= ~WATER_PENDING;
+
+	if(bg->mode == WATER_CACHED) {
+		WaterCacheStore(bg);
+		return;
 	}
 
 	UpdateTexture(bg->output, bg->output_px);
-	bg->timer = 0.0175f;
+}
+
+// Draw scrolled water into output on the GPU path, call before output is sampled
+void WaterRender(WaterBackground *bg) {
+	if(bg->mode != WATER_GPU || !(bg->flags & WATER_DIRTY)) return;
+
+	int scroll[2] = { bg->scroll_x, bg->scroll_y };
+	int offset = bg->offset;
+
+	rlDrawRenderBatchActive();
+
+	rlEnableFramebuffer(bg->target.id);
+	rlViewport(0, 0, WATER_SIZE, WATER_SIZE);
+
+	// Every pixel is overwritten
+	rlDisableColorBlend();
+	rlEnableShader(bg->shader.id);
+
+	rlSetUniform(water_scroll_loc, scroll, SHADER_UNIFORM_IVEC2, 1);
+	rlSetUniform(water_offset_loc, &offset, SHADER_UNIFORM_INT, 1);
+	rlSetUniform(water_filter_loc, &bg->filter, SHADER_UNIFORM_FLOAT, 1);
+
+	rlActiveTextureSlot(0);
+	rlEnableTexture(bg->noise_tex.id);
+
+	rlLoadDrawQuad();
+
+	rlDisableTexture();
+	rlDisableShader();
+	rlEnableColorBlend();
+
+	rlDisableFramebuffer();
+	rlViewport(0, 0, GetRenderWidth(), GetRenderHeight());
+
+	bg->flags &= ~WATER_DIRTY;
 }
 
 void WaterDraw(WaterBackground *bg, int ww, int wh) {
@@ -81,17 +255,24 @@ void WaterDraw(WaterBackground *bg, int ww, int wh) {
 	//DrawText(TextFormat("%.3f", bg->filter), 0, 0, 40, RAYWHITE);
 }
 
-void WaterDrawTile(WaterBackground *bg, int x, int y) {
-	int w = 512 * 0.5f;
-	int h = 512 * 0.5f;
+void WaterClose(WaterBackground *bg) {
+	WaterFinish(bg);
 
-	//DrawTextureRec(bg->output, (Rectangle) { x * w, y * h, w, h }, Vector2Zero(), WHITE);
-	//DrawTexturePro(bg->output, (Rectangle){x * w, y * h, w, h}, (Rectangle){0, 0, w, -h}, Vector2Zero(), 0, WHITE);
-	DrawTexturePro(bg->output, (Rectangle){x * w, y * h, w, h}, (Rectangle){0, 0, w, -h}, Vector2Zero(), 0, WHITE);
-}
+	if(bg->mode == WATER_GPU) {
+		UnloadRenderTexture(bg->target);
+		UnloadTexture(bg->noise_tex);
+		UnloadShader(bg->shader);
+	} else if(bg->mode == WATER_CACHED) {
+		for(int i = 0; i < bg->cache.frame_count; i++) {
+			if(bg->cache.frames[i].id) UnloadTexture(bg->cache.frames[i]);
+		}
+
+		UnloadTexture(bg->cache.live);
+		free(bg->cache.frames);
+		free(bg->cache.baked);
+	} else
+		UnloadTexture(bg->output);	
 
-void WaterClose(WaterBackground *bg) {
-	UnloadTexture(bg->output);	
 	free(bg->output_px);
 	free(bg->noise);
 }
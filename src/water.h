@@ -1,29 +1,107 @@
 #include <stdint.h>
 #include "raylib.h"
+#include "jobs.h"
 
 #ifndef WATER_H_
 #define WATER_H_
 
-#define PX_COUNT (uint32_t)(512 * 512)
+#define WATER_SIZE	512
+#define PX_COUNT (uint32_t)(WATER_SIZE * WATER_SIZE)
+
+// Both scrolls step one pixel per tick, output repeats after this many ticks
+#define WATER_PERIOD	WATER_SIZE
+
+// Cache budget used when none is configured, in megabytes
+#define WATER_CACHE_DEFAULT_MB	128
+
+// Flags
+#define WATER_DIRTY		0x01	// Scrolled since output was last drawn, GPU path only
+#define WATER_PENDING	0x02	// Bands of output_px in flight on workers, CPU path only
+
+// Output rows per worker job
+#define WATER_BAND_ROWS	32
+
+// Sums of two noise samples, 0 to 510
+#define WATER_SUM_COUNT	511
+
+// Output is one byte per pixel, a gray value of at most 201 or one of these codes,
+// the water light shader turns them into colors, keep in sync with the light shaders
+#define WATER_CODE_DARK		254		// { 0, 0, 0, 100 }
+#define WATER_CODE_LIGHT	255		// { 240, 240, 250, 100 }
+
+enum WATER_MODES : uint8_t {
+	WATER_CPU,		// Pixels computed on CPU and uploaded every tick
+	WATER_GPU,		// Fragment shader draws output into a render texture
+	WATER_CACHED	// CPU path, ticks of the period kept as textures and replayed
+};
+
+// Baked ticks of one period, a replayed tick only swaps output to its frame
+typedef struct {
+	Texture2D *frames;	// Indexed by tick, created on first bake
+	uint8_t *baked;		// Frame holds the current filter
+
+	// Ticks fitting the budget, later ticks are computed every time
+	uint16_t frame_count;
+
+	// Filter of baked frames, a change invalidates all of them
+	float filter;
+
+	// Upload target of ticks past frame_count
+	Texture2D live;
+
+} WaterCache;
 
 typedef struct {
-	Texture2D output;
+	Texture2D output;	// One channel, see WATER_CODE_DARK
 
-	Color *output_px;
+	uint8_t *output_px;
 	uint8_t *noise;
 
+	// GPU path only, output is the target's color texture
+	RenderTexture2D target;
+	Texture2D noise_tex;
+	Shader shader;
+
+	// CPU path, bands of the current tick, joined by WaterFinish
+	JobBatch batch;
+
+	// Cached path only
+	WaterCache cache;
+	uint16_t cache_mb;	// Budget of cache frames, set before WaterInit, 0 picks the default
+
 	float timer;
 	float filter;
 
 	uint16_t scroll_x, scroll_y;
 	uint16_t offset;
 
+	uint8_t mode;	// WATER_MODES, set before WaterInit, falls back to CPU when the shader fails
+	uint8_t flags;
+
 } WaterBackground;
 
+// Computes output_px rows [row_begin, row_end) of the current tick, see water_kernel.c
+typedef void (*WaterKernel)(const WaterBackground *bg, int row_begin, int row_end);
+
+// Output pixel of every noise sum under filter, vector kernels look pixels up in it
+void WaterPixelTable(float filter, uint8_t *table);
+
+void WaterKernelScalar(const WaterBackground *bg, int row_begin, int row_end);
+void WaterKernelSSE2(const WaterBackground *bg, int row_begin, int row_end);
+void WaterKernelAVX2(const WaterBackground *bg, int row_begin, int row_end);
+
+// Widest kernel the CPU runs
+WaterKernel WaterKernelSelect();
+
 void WaterInit(WaterBackground *bg);
+// Advance a tick, CPU path starts computing output on workers and returns
 void WaterUpdate(WaterBackground *bg, float dt);
+
+// Wait for the tick's bands and upload them, CPU path only, call before output is drawn
+void WaterFinish(WaterBackground *bg);
+
+void WaterRender(WaterBackground *bg);
 void WaterDraw(WaterBackground *bg, int ww, int wh);
-void WaterDrawTile(WaterBackground *bg, int x, int y);
 void WaterClose(WaterBackground *bg);
 
 #endif
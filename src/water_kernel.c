@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <string.h>
+#include "raylib.h"
+#include "raymath.h"
+#include "water.h"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// Output pixel of one noise sum, the float math of the original per pixel loop
+static inline uint8_t WaterPixel(uint32_t sum, float filter) {
+	float val = Clamp(sum * filter, 0, 255);
+	uint8_t processed = val;
+
+	float intensity = val / 255.0f;
+
+	if(intensity > 0.79f) processed = WATER_CODE_DARK;
+	if(intensity > 0.99f) processed = WATER_CODE_LIGHT;
+
+	return processed;
+}
+
+void WaterPixelTable(float filter, uint8_t *table) {
+	for(uint32_t sum = 0; sum < WATER_SUM_COUNT; sum++)
+		table[sum] = WaterPixel(sum, filter);
+}
+
+// Reference kernel, per pixel modulo and float math
+void WaterKernelScalar(const WaterBackground *bg, int row_begin, int row_end) {
+	for(uint32_t i = row_begin * WATER_SIZE; i < (uint32_t)row_end * WATER_SIZE; i++) {
+		uint32_t x = ((i % 512) + bg->scroll_x) % 512; 
+		uint32_t y = ((i / 512) + bg->scroll_y) % 512;
+		uint32_t idxA = (x + y * 512);
+
+		uint32_t offx = ((i % 512) - bg->scroll_x + bg->offset) % 512;
+		uint32_t offy = ((i / 512) - bg->scroll_y - bg->offset) % 512;
+		uint32_t idxB = (offx + offy * 512);
+
+		bg->output_px[i] = WaterPixel(bg->noise[idxA] + bg->noise[idxB], bg->filter);
+	}
+}
+
+// Noise rows of output row y rotated to start at each sample's first pixel,
+// the wrap becomes two contiguous copies instead of a modulo per pixel
+static void WaterRowSources(const WaterBackground *bg, int y, uint8_t *row_a, uint8_t *row_b) {
+	const uint8_t *src_a = &bg->noise[((y + bg->scroll_y) & (WATER_SIZE - 1)) * WATER_SIZE];
+	const uint8_t *src_b = &bg->noise[((y - bg->scroll_y - bg->offset) & (WATER_SIZE - 1)) * WATER_SIZE];
+
+	int start_a = bg->scroll_x & (WATER_SIZE - 1);
+	int start_b = (bg->offset - bg->scroll_x) & (WATER_SIZE - 1);
+
+	memcpy(row_a, src_a + start_a, WATER_SIZE - start_a);
+	memcpy(row_a + WATER_SIZE - start_a, src_a, start_a);
+
+	memcpy(row_b, src_b + start_b, WATER_SIZE - start_b);
+	memcpy(row_b + WATER_SIZE - start_b, src_b, start_b);
+}
+
+#ifdef __SSE2__
+
+// 16 pixels per step, sums in 16 bit lanes looked up in the filter's pixel table
+void WaterKernelSSE2(const WaterBackground *bg, int row_begin, int row_end) {
+	uint8_t row_a[WATER_SIZE], row_b[WATER_SIZE];
+	uint16_t sums[16];
+
+	uint8_t table[WATER_SUM_COUNT];
+	WaterPixelTable(bg->filter, table);
+
+	const __m128i zero = _mm_setzero_si128();
+
+	for(int y = row_begin; y < row_end; y++) {
+		WaterRowSources(bg, y, row_a, row_b);
+		uint8_t *out = &bg->output_px[y * WATER_SIZE];
+
+		for(int x = 0; x < WATER_SIZE; x += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)&row_a[x]);
+			__m128i b = _mm_loadu_si128((const __m128i*)&row_b[x]);
+
+			_mm_storeu_si128((__m128i*)&sums[0], _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+			_mm_storeu_si128((__m128i*)&sums[8], _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+
+			for(int n = 0; n < 16; n++)
+				out[x + n] = table[sums[n]];
+		}
+	}
+}
+
+// 16 pixels per step, gathered from the filter's pixel table widened to 32 bits
+__attribute__((target("avx2")))
+void WaterKernelAVX2(const WaterBackground *bg, int row_begin, int row_end) {
+	uint8_t row_a[WATER_SIZE], row_b[WATER_SIZE];
+
+	uint8_t table[WATER_SUM_COUNT];
+	WaterPixelTable(bg->filter, table);
+
+	int32_t table_32[WATER_SUM_COUNT];
+	for(int sum = 0; sum < WATER_SUM_COUNT; sum++)
+		table_32[sum] = table[sum];
+
+	for(int y = row_begin; y < row_end; y++) {
+		WaterRowSources(bg, y, row_a, row_b);
+		__m128i *out = (__m128i*)&bg->output_px[y * WATER_SIZE];
+
+		for(int x = 0; x < WATER_SIZE; x += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)&row_a[x]);
+			__m128i b = _mm_loadu_si128((const __m128i*)&row_b[x]);
+
+			__m256i sum_lo = _mm256_add_epi32(_mm256_cvtepu8_epi32(a), _mm256_cvtepu8_epi32(b));
+			__m256i sum_hi = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(a, 8)), _mm256_cvtepu8_epi32(_mm_srli_si128(b, 8)));
+
+			__m256i px_lo = _mm256_i32gather_epi32(table_32, sum_lo, 4);
+			__m256i px_hi = _mm256_i32gather_epi32(table_32, sum_hi, 4);
+
+			// Pack works per 128 bit half, reorder quarters to pixels 0-7 then 8-15 before narrowing
+			__m256i px = _mm256_permute4x64_epi64(_mm256_packus_epi32(px_lo, px_hi), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128(out++, _mm_packus_epi16(_mm256_castsi256_si128(px), _mm256_extracti128_si256(px, 1)));
+		}
+	}
+}
+
+#endif
+
+WaterKernel WaterKernelSelect() {
+#ifdef __SSE2__
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) return WaterKernelAVX2;
+
+	return WaterKernelSSE2;
+#else
+	return WaterKernelScalar;
+#endif
+}